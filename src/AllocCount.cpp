@@ -0,0 +1,53 @@
+#include "AllocCount.h"
+
+#ifdef COUNT_ALLOCATIONS
+#    include <atomic>
+#    include <cstdlib>
+#    include <new>
+
+static std::atomic<size_t> allocations(0);
+
+size_t allocationCount() {
+    return allocations.load();
+}
+
+static void* countedAlloc(size_t size) {
+    ++allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size) {
+    return countedAlloc(size);
+}
+void* operator new[](size_t size) {
+    return countedAlloc(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept {
+    free(p);
+}
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+#else
+size_t allocationCount() {
+    return 0;
+}
+#endif
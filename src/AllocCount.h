@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts heap allocations in builds made with -DCOUNT_ALLOCATIONS (the
+// *-alloc-count environments in platformio.ini), so tests can check
+// that the streaming paths do not allocate once warmed up.  In normal
+// builds the count is always 0.
+size_t allocationCount();
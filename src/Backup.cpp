@@ -0,0 +1,292 @@
+#include "Backup.h"
+#include "Deflate.h"
+#include "FileSystem.h"
+#include "GCodeFile.h"
+#include "RemoteFiles.h"
+#include "Upload.h"
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+static const size_t BLOCK = 512;
+
+// A bounded byte pipe between two threads.  Writes block while it is
+// full and reads while it is empty, until close().
+class PipeBuffer : public std::streambuf {
+private:
+    std::vector<char>       m_ring;
+    uint64_t                m_written = 0;
+    uint64_t                m_read    = 0;
+    bool                    m_closed  = false;
+    std::mutex              m_mutex;
+    std::condition_variable m_changed;
+    char                    m_get[64 << 10];
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (std::streamsize done = 0; done < n;) {
+            m_changed.wait(lock, [this] { return m_written - m_read < m_ring.size(); });
+            size_t at    = size_t(m_written % m_ring.size());
+            size_t count = std::min(std::min(m_ring.size() - size_t(m_written - m_read), m_ring.size() - at), size_t(n - done));
+            memcpy(&m_ring[at], s + done, count);
+            m_written += count;
+            done += count;
+            m_changed.notify_all();
+        }
+        return n;
+    }
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            char ch = traits_type::to_char_type(c);
+            xsputn(&ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+    int_type underflow() override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this] { return m_written > m_read || m_closed; });
+        if (m_written == m_read) {
+            return traits_type::eof();
+        }
+        size_t at    = size_t(m_read % m_ring.size());
+        size_t count = std::min(std::min(size_t(m_written - m_read), m_ring.size() - at), sizeof(m_get));
+        memcpy(m_get, &m_ring[at], count);
+        m_read += count;
+        m_changed.notify_all();
+        setg(m_get, m_get, m_get + count);
+        return traits_type::to_int_type(*m_get);
+    }
+
+public:
+    PipeBuffer() : m_ring(4 << 20) {}
+
+    // The reader sees the end once it has everything written
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_changed.notify_all();
+    }
+};
+
+static bool endsWith(const std::string& s, const char* tail) {
+    size_t n = strlen(tail);
+    return s.length() >= n && s.compare(s.length() - n, n, tail) == 0;
+}
+
+static void octal(char* field, size_t width, uint64_t value) {
+    snprintf(field, width, "%0*llo", int(width - 1), (unsigned long long)value);
+}
+
+// Writes a ustar header.  Names too long for the name field are split
+// at a slash into the prefix field.
+static bool writeTarHeader(std::ostream& out, const std::string& path, uint64_t size) {
+    char        header[BLOCK] = { 0 };
+    std::string prefix;
+    std::string name  = path;
+    auto        slash = path.find('/', path.length() > 100 ? path.length() - 101 : 0);
+    if (path.length() > 100) {
+        if (slash == std::string::npos || slash > 155) {
+            return false;
+        }
+        prefix = path.substr(0, slash);
+        name   = path.substr(slash + 1);
+    }
+    memcpy(header, name.data(), name.length());
+    octal(header + 100, 8, 0644);
+    octal(header + 108, 8, 0);
+    octal(header + 116, 8, 0);
+    octal(header + 124, 12, size);
+    octal(header + 136, 12, uint64_t(time(nullptr)));
+    header[156] = '0';
+    memcpy(header + 257, "ustar\0" "00", 8);
+    memcpy(header + 345, prefix.data(), prefix.length());
+
+    // The checksum is taken with its own field as spaces
+    memset(header + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < BLOCK; ++i) {
+        sum += (unsigned char)header[i];
+    }
+    snprintf(header + 148, 8, "%06o", sum);
+    out.write(header, BLOCK);
+    return true;
+}
+
+static void padBlock(std::ostream& out, uint64_t size) {
+    static const char zeros[BLOCK] = { 0 };
+    out.write(zeros, (BLOCK - size % BLOCK) % BLOCK);
+}
+
+int backupFilesystem(SerialPort& serial, const std::string& archive) {
+    std::vector<std::string> names;  // remote paths
+    std::vector<int64_t>     sizes;
+    for (const char* root : { "/localfs/", "/sd/" }) {
+        std::vector<RemoteFile> files;
+        if (!listRemoteTree(serial, root, files)) {
+            std::cout << "Cannot list " << root << ", skipping it" << std::endl;
+            continue;
+        }
+        for (auto& file : files) {
+            names.push_back(root + file.name);
+            sizes.push_back(file.size);
+        }
+    }
+
+    std::ofstream file(archive, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (file.fail()) {
+        std::cout << "Can't create " << archive << std::endl;
+        return -1;
+    }
+
+    // Compressing takes place while the next file downloads: the tar
+    // stream goes through a pipe to a GzipCompressor, whose output a
+    // second thread writes to the file
+    bool                            gzip = endsWith(archive, ".gz") || endsWith(archive, ".tgz");
+    PipeBuffer                      pipe;
+    std::istream                    pipeIn(&pipe);
+    std::ostream                    tar(gzip ? static_cast<std::streambuf*>(&pipe) : file.rdbuf());
+    std::unique_ptr<GzipCompressor> compressor;
+    std::thread                     writer;
+    if (gzip) {
+        compressor.reset(new GzipCompressor(pipeIn));
+        writer = std::thread([&]() { file << compressor.get(); });
+    }
+
+    int      saved = 0, incomplete = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::cout << "XModem Download " << names[i] << " (" << i + 1 << " of " << names.size() << ")" << std::endl;
+        std::ostringstream data;
+        int received = downloadStream(serial, names[i], data, sizes[i]);
+        if (received < 0) {
+            std::cout << "Skipping " << names[i] << std::endl;
+            continue;
+        }
+        // A transfer cut short is not archived as if it were the file
+        if (sizes[i] >= 0 && received != sizes[i]) {
+            std::cout << "Skipping " << names[i] << ", it did not download completely" << std::endl;
+            ++incomplete;
+            continue;
+        }
+        std::string contents = data.str();
+        if (!writeTarHeader(tar, names[i].substr(1), contents.length())) {
+            std::cout << "The name " << names[i] << " is too long for tar, skipping it" << std::endl;
+            continue;
+        }
+        tar.write(contents.data(), contents.length());
+        padBlock(tar, contents.length());
+        total += contents.length();
+        ++saved;
+    }
+    // Two zero blocks end the archive
+    static const char zeros[2 * BLOCK] = { 0 };
+    tar.write(zeros, sizeof(zeros));
+    tar.flush();
+
+    if (gzip) {
+        pipe.close();
+        writer.join();
+        if (compressor->size() < 0) {
+            file.setstate(std::ios::badbit);
+        }
+    }
+    file.close();
+    if (file.fail()) {
+        std::cout << "Writing " << archive << " failed" << std::endl;
+        return -1;
+    }
+    std::cout << "Saved " << saved << " of " << names.size() << " files, " << total << " bytes, to " << archive;
+    if (incomplete) {
+        std::cout << "; " << incomplete << " downloaded incompletely";
+    }
+    std::cout << std::endl;
+    return saved;
+}
+
+// Parses a tar octal number field
+static uint64_t fromOctal(const char* field, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+int restoreFilesystem(SerialPort& serial, const std::string& archive) {
+    GCodeFile in(archive);
+    if (in.fail()) {
+        std::cout << "Can't open " << archive << std::endl;
+        return -1;
+    }
+
+    // The files are unpacked into the cache directory, then uploaded
+    std::string             dir = cacheDirectory() + "/restore";
+    std::vector<UploadItem> items;
+    char                    header[BLOCK];
+    std::vector<char>       buffer(1 << 20);
+    bool                    ok = true;
+    while (in.read(header, BLOCK) && header[0]) {
+        std::string name(header, strnlen(header, 100));
+        if (header[345]) {
+            name = std::string(header + 345, strnlen(header + 345, 155)) + "/" + name;
+        }
+        uint64_t size = fromOctal(header + 124, 12);
+        bool     keep = (header[156] == '0' || header[156] == '\0') && name.find("..") == std::string::npos &&
+                    (name.compare(0, 8, "localfs/") == 0 || name.compare(0, 3, "sd/") == 0);
+
+        std::string   path = dir + "/" + name;
+        std::ofstream out;
+        if (keep) {
+            makeDirectories(path.substr(0, path.rfind('/')));
+            out.open(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+            if (out.fail()) {
+                std::cout << "Can't create " << path << std::endl;
+                keep = false;
+            }
+        }
+        for (uint64_t left = size + (BLOCK - size % BLOCK) % BLOCK, data = size; left;) {
+            size_t n = size_t(std::min<uint64_t>(left, buffer.size()));
+            if (!in.read(buffer.data(), n)) {
+                break;
+            }
+            if (keep) {
+                out.write(buffer.data(), std::streamsize(std::min<uint64_t>(n, data)));
+            }
+            data -= std::min<uint64_t>(n, data);
+            left -= n;
+        }
+        if (in.fail()) {
+            if (keep) {
+                out.close();
+                removeFile(path);
+            }
+            std::cout << archive << " is truncated or corrupt" << std::endl;
+            ok = false;
+            break;
+        }
+        if (keep) {
+            items.push_back({ path, "/" + name });
+        }
+    }
+
+    int restored = -1;
+    if (ok) {
+        // Restored files keep their stored names and contents
+        setUploadCompress(false);
+        restored = uploadFiles(serial, items);
+        std::cout << (restored < 0 ? 0 : restored) << " of " << items.size() << " files restored" << std::endl;
+    }
+    for (auto& item : items) {
+        removeFile(item.path);
+    }
+    return restored;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "SerialPort.h"
+#include <string>
+
+// Downloads every file on the controller's local filesystem and SD card
+// into a tar archive, gzipped on its own thread if the name ends in .gz
+// or .tgz.  Files are stored as localfs/<path> and sd/<path>.  Returns
+// the number of files saved, or negative on error.
+int backupFilesystem(SerialPort& serial, const std::string& archive);
+
+// Uploads the files in an archive made by backupFilesystem back to
+// where they came from, uncompressed and verified.  Returns the number
+// of files restored, or negative on error.
+int restoreFilesystem(SerialPort& serial, const std::string& archive);
@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
-#include <string>
 #include <iostream>
-#include <sstream>
+#include <string>
 #include "Colorize.h"
+#include "AllocCount.h"
 
 static const char* gray          = "\x1b[0;37;40m";
 static const char* red           = "\x1b[31m";
@@ -27,55 +31,9 @@ static const char* setting_color = bold_cyan;
 static const char* value_color   = bold_yellow;
 static const char* info_color    = bold_yellow;
 
-static void out(char c) {
-    std::cout << c;
-}
 static void out(const char* s) {
     std::cout << s;
 }
-static void out(std::string s) {
-    std::cout << s;
-}
-
-static bool colorizedSetting(std::string& line) {
-    if (line.length() && line[0] == '$') {
-        auto pos = line.find('=');
-        if (pos == std::string::npos) {
-            return false;
-        }
-        out(line[0]);
-        out(setting_color);
-        out(line.substr(1, pos - 1));
-        out(equals_color);
-        out(line.substr(pos, 1));
-        out(value_color);
-        out(line.substr(pos + 1));
-        out(input_color);
-        out('\n');
-        return true;
-    } else {
-        return false;
-    }
-}
-
-static bool colorized(std::string& line, const char* tag, const char* color) {
-    if (line.compare(0, strlen(tag), tag) != 0) {
-        return false;
-    }
-    int offset = 0;
-
-    if (*tag == '[' || *tag == '<') {
-        offset = 1;
-        out(*tag);
-    }
-    out(color);
-    out(tag + offset);
-    out(input_color);
-    out(line.substr(strlen(tag)));
-    out('\n');
-
-    return true;
-}
 
 void errorColor() {
     out(error_color);
@@ -90,53 +48,220 @@ void infoColor() {
     out(info_color);
 }
 
-static void colorizeLine(std::string line) {
-    // clang-format off
-    bool matched = colorizedSetting(line) ||
-            colorized(line, "[MSG:INFO", good_color)  ||
-            colorized(line, "[MSG:ERR",  error_color) ||
-            colorized(line, "[MSG:WARN", warn_color)  ||
-            colorized(line, "[MSG:DBG",  debug_color) ||
-            colorized(line, "<Alarm",    warn_color)  ||
-            colorized(line, "<Idle",     good_color)  ||
-            colorized(line, "<Run",      good_color)  ||
-            colorized(line, "error",     error_color);
-    // clang-format on
-    if (!matched) {
-        out(line);
-        out('\n');
+// The line starts that are colored.  A setting, "$name=value", is
+// colored only once its '=' arrives.
+struct Tag {
+    const char*        text;
+    const char* const* color;  // nullptr for a setting
+};
+
+// clang-format off
+static constexpr Tag tags[] = {
+    { "$",         nullptr      },
+    { "[MSG:INFO", &good_color  },
+    { "[MSG:ERR",  &error_color },
+    { "[MSG:WARN", &warn_color  },
+    { "[MSG:DBG",  &debug_color },
+    { "<Alarm",    &warn_color  },
+    { "<Idle",     &good_color  },
+    { "<Run",      &good_color  },
+    { "error",     &error_color },
+};
+// clang-format on
+
+// The tags as a trie built at compile time, so a line start is matched
+// one byte at a time with a table lookup, and never needs rescanning
+struct TagTrie {
+    static constexpr int NODES = 48;
+
+    uint8_t next[NODES][128];  // 0 where there is no edge, as the root is no node's child
+    int8_t  tag[NODES];        // the tag that ends at a node, or -1
+    int     nodes;
+
+    constexpr TagTrie() : next(), tag(), nodes(1) {
+        for (int n = 0; n < NODES; ++n) {
+            tag[n] = -1;
+        }
+        for (int t = 0; t < int(sizeof(tags) / sizeof(tags[0])); ++t) {
+            int node = 0;
+            for (const char* c = tags[t].text; *c; ++c) {
+                if (!next[node][int(*c)]) {
+                    next[node][int(*c)] = uint8_t(nodes++);
+                }
+                node = next[node][int(*c)];
+            }
+            tag[node] = int8_t(t);
+        }
+    }
+};
+
+static constexpr TagTrie trie;
+static_assert(trie.nodes <= TagTrie::NODES, "TagTrie::NODES is too small for the tags");
+
+// The output for a chunk is gathered here and written at once.  Only a
+// chunk whose output will not fit is written in pieces.
+static char   outBuf[16 << 10];
+static size_t outLen = 0;
+
+static void flushOut() {
+    if (outLen) {
+        std::cout.write(outBuf, outLen);
+        outLen = 0;
+    }
+}
+
+static void emit(const char* s, size_t len) {
+    if (outLen + len > sizeof(outBuf)) {
+        flushOut();
+        if (len > sizeof(outBuf)) {
+            std::cout.write(s, len);
+            return;
+        }
     }
+    memcpy(outBuf + outLen, s, len);
+    outLen += len;
+}
+static void emit(const char* s) {
+    emit(s, strlen(s));
+}
+static void emit(char c) {
+    emit(&c, 1);
 }
 
-static std::string residue = "";
+// Where the current line is:
+//   Prefix - matching the tags; what matched so far is held in `pending`
+//   Name   - a setting's name, held in `pending` until its '='
+//   Value  - a setting's value, passed through until the end of the line
+//   Rest   - the rest of any other line, passed through
+enum class LineState { Prefix, Name, Value, Rest };
+
+static LineState state = LineState::Prefix;
+static int       node  = 0;
+
+// The start of a line whose color is not known yet.  A setting name
+// longer than this is written out uncolored rather than growing a buffer.
+static char   pending[1024];
+static size_t pendingLen = 0;
 
 static bool expectingEcho = false;
 
+#ifdef COUNT_ALLOCATIONS
+static size_t calls       = 0;
+static size_t allocations = 0;
+
+size_t colorizeAllocations() {
+    return allocations;
+}
+#endif
+
 void expectEcho() {
     expectingEcho = true;
 }
 
-void colorizeOutput(const char* buf, size_t len) {
-    //    out('{');    out(residue);     out('}');
-    std::string next(buf, len);
-    residue += next;
-
-    std::istringstream lines(residue);
-    residue.clear();
-    int lineCnt = 0;
-    while (lines.good()) {
-        std::string line;
-        std::getline(lines, line, '\n');
-        if (lines.eof()) {
-            // Partial line at end
-            residue = line;
-        } else {
-            ++lineCnt;
-            colorizeLine(line);
+static void startLine() {
+    state      = LineState::Prefix;
+    node       = 0;
+    pendingLen = 0;
+}
+
+static void emitTag(const Tag& tag) {
+    int offset = 0;
+    if (*tag.text == '[' || *tag.text == '<') {
+        offset = 1;
+        emit(*tag.text);
+    }
+    emit(*tag.color);
+    emit(tag.text + offset);
+    emit(input_color);
+}
+
+static void colorizeChunk(const char* p, size_t len) {
+    const char* end     = p + len;
+    int         lineCnt = 0;
+    while (p < end) {
+        switch (state) {
+            case LineState::Prefix: {
+                uint8_t c    = uint8_t(*p);
+                int     next = c < 128 ? trie.next[node][c] : 0;
+                if (!next) {
+                    // Not a tag, so the line goes out as it is
+                    emit(pending, pendingLen);
+                    pendingLen = 0;
+                    state      = LineState::Rest;
+                    break;
+                }
+                pending[pendingLen++] = char(c);
+                node                  = next;
+                ++p;
+                if (trie.tag[node] >= 0) {
+                    const Tag& tag = tags[trie.tag[node]];
+                    if (tag.color) {
+                        emitTag(tag);
+                        pendingLen = 0;
+                        state      = LineState::Rest;
+                    } else {
+                        state = LineState::Name;
+                    }
+                }
+                break;
+            }
+            case LineState::Name: {
+                auto        nl    = (const char*)memchr(p, '\n', end - p);
+                const char* limit = nl ? nl : end;
+                auto        eq    = (const char*)memchr(p, '=', limit - p);
+                const char* stop  = eq ? eq : limit;
+                if (pendingLen + (stop - p) > sizeof(pending)) {
+                    emit(pending, pendingLen);
+                    pendingLen = 0;
+                    state      = LineState::Rest;
+                    break;
+                }
+                memcpy(pending + pendingLen, p, stop - p);
+                pendingLen += stop - p;
+                p = stop;
+                if (eq) {
+                    emit('$');
+                    emit(setting_color);
+                    emit(pending + 1, pendingLen - 1);
+                    emit(equals_color);
+                    emit('=');
+                    emit(value_color);
+                    pendingLen = 0;
+                    state      = LineState::Value;
+                    ++p;
+                } else if (nl) {
+                    emit(pending, pendingLen);
+                    emit('\n');
+                    startLine();
+                    ++lineCnt;
+                    ++p;
+                }
+                break;
+            }
+            case LineState::Value:
+            case LineState::Rest: {
+                auto nl = (const char*)memchr(p, '\n', end - p);
+                if (!nl) {
+                    emit(p, end - p);
+                    p = end;
+                    break;
+                }
+                emit(p, nl - p);
+                if (state == LineState::Value) {
+                    emit(input_color);
+                }
+                emit('\n');
+                startLine();
+                ++lineCnt;
+                p = nl + 1;
+                break;
+            }
         }
     }
-    if (residue.length() &&
-        ((lineCnt == 0 && (expectingEcho || residue.length() == 1 || (residue[0] != '<' && residue[0] != '[' && residue[0] != '$'))))) {
+
+    bool partial = state != LineState::Prefix || pendingLen;
+    if (partial && lineCnt == 0 &&
+        (expectingEcho || pendingLen == 1 || (pendingLen && pending[0] != '<' && pending[0] != '[' && pending[0] != '$'))) {
         //   If there were no complete lines and there are extra
         // characters that do not form a complete lines, we send
         // the extra characters immediately, as they probably
@@ -147,11 +272,73 @@ void colorizeOutput(const char* buf, size_t len) {
         // did not fit entirely in the serial input buffer.
         // However, if that residue cannot possibly be the
         // start of a colorized sequence, we send it anyway.
+        //   Only a line whose color is still undecided is held
+        // back at all; the rest of it starts afresh, as a line.
         //   This heuristic is probably imperfect; distinguishing
         // between echo of interaction and program output is
         // tricky.
         expectingEcho = false;
-        out(residue);
-        residue.clear();
+        if (pendingLen) {
+            emit(pending, pendingLen);
+            startLine();
+        }
+    }
+    flushOut();
+}
+
+void colorizeOutput(const char* buf, size_t len) {
+#ifdef COUNT_ALLOCATIONS
+    // The first calls may grow std::cout's buffers
+    size_t before = allocationCount();
+    colorizeChunk(buf, len);
+    if (++calls > 16) {
+        allocations += allocationCount() - before;
+    }
+#else
+    colorizeChunk(buf, len);
+#endif
+}
+
+// Discards what is written to it
+class NullBuffer : public std::streambuf {
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    int_type        overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+void benchmarkColorize(std::ostream& out) {
+    // Console traffic like a $S and $CD dump, with status reports and
+    // messages among the acknowledgements
+    std::string sample;
+    for (int i = 0; sample.length() < (1 << 20); ++i) {
+        sample += "$Stepper/Axis" + std::to_string(i % 6) + "/MaxRate=" + std::to_string(1000 + i) + ".000\r\n";
+        sample += "    steps_per_mm: 80.000\r\n    max_rate_mm_per_min: 5000.000\r\n";
+        sample += "<Idle|MPos:0.000,0.000,0.000|FS:0,0|WCO:0.000,0.000,0.000>\r\n";
+        sample += "[MSG:INFO: Axis count 3]\r\n";
+        sample += "ok\r\n";
+    }
+
+    // Serial reads on Windows are 128 bytes; larger ones show the limit
+    NullBuffer discard;
+    char       text[120];
+    for (size_t chunk : { size_t(128), size_t(4096) }) {
+        const int       passes  = 32;
+        std::streambuf* console = std::cout.rdbuf(&discard);
+        auto            start   = std::chrono::steady_clock::now();
+        for (int i = 0; i < passes; ++i) {
+            for (size_t at = 0; at < sample.length(); at += chunk) {
+                colorizeOutput(sample.data() + at, std::min(chunk, sample.length() - at));
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout.rdbuf(console);
+        snprintf(text,
+                 sizeof(text),
+                 "%5lu-byte reads: %lu bytes in %.3f s: %.1f MB/s",
+                 (unsigned long)chunk,
+                 (unsigned long)(passes * sample.length()),
+                 seconds,
+                 seconds > 0 ? passes * sample.length() / seconds / 1e6 : 0.0);
+        out << text << std::endl;
     }
 }
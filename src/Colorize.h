@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <ostream>
+
 void expectEcho();
 void colorizeOutput(const char* buf, size_t len);
 
@@ -7,3 +10,12 @@ void goodColor();
 void errorColor();
 void normalColor();
 void infoColor();
+
+// Feeds a sample of console traffic through colorizeOutput() with the
+// console discarded and reports the throughput
+void benchmarkColorize(std::ostream& out);
+
+#ifdef COUNT_ALLOCATIONS
+// Heap allocations made by colorizeOutput() after its first few calls
+size_t colorizeAllocations();
+#endif
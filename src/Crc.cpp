@@ -0,0 +1,337 @@
+#include "Crc.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#    define HAVE_PCLMUL
+#    include <cpuid.h>
+#    include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#    define HAVE_ARM_CRC
+#    include <arm_acle.h>
+#endif
+
+// Slicing-by-8 tables: entry [k][n] is the CRC of byte n followed by k
+// zero bytes, so eight bytes are taken with eight lookups at once
+struct CrcTables {
+    uint32_t reflected[8][256];  // gzip, LSB first
+    uint32_t msbFirst[8][256];   // STM32
+    uint16_t ccitt[8][256];
+
+    CrcTables() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t r = n;
+            uint32_t m = n << 24;
+            uint16_t c = uint16_t(n << 8);
+            for (int k = 0; k < 8; ++k) {
+                r = r & 1 ? 0xedb88320 ^ (r >> 1) : r >> 1;
+                m = m & 0x80000000 ? 0x04c11db7 ^ (m << 1) : m << 1;
+                c = c & 0x8000 ? uint16_t(0x1021 ^ (c << 1)) : uint16_t(c << 1);
+            }
+            reflected[0][n] = r;
+            msbFirst[0][n]  = m;
+            ccitt[0][n]     = c;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int n = 0; n < 256; ++n) {
+                reflected[k][n] = (reflected[k - 1][n] >> 8) ^ reflected[0][reflected[k - 1][n] & 0xff];
+                msbFirst[k][n]  = (msbFirst[k - 1][n] << 8) ^ msbFirst[0][msbFirst[k - 1][n] >> 24];
+                ccitt[k][n]     = uint16_t(ccitt[k - 1][n] << 8) ^ ccitt[0][ccitt[k - 1][n] >> 8];
+            }
+        }
+    }
+};
+
+static const CrcTables& tables() {
+    static const CrcTables t;
+    return t;
+}
+
+static inline uint32_t load32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+static inline uint32_t reverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+// The kernels work on the register itself, without gzip's inversions
+
+static uint32_t crc32Table(uint32_t crc, const uint8_t* p, size_t len) {
+    const auto& t = tables().reflected;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t a = crc ^ load32(p);
+        uint32_t b = load32(p + 4);
+        crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^ t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff] ^
+              t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+    }
+    while (len--) {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static uint32_t stm32Table(uint32_t crc, const uint8_t* p, size_t len) {
+    const auto& t = tables().msbFirst;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t a = crc ^ load32(p);
+        uint32_t b = load32(p + 4);
+        crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff] ^ t[3][b >> 24] ^ t[2][(b >> 16) & 0xff] ^
+              t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+    }
+    if (len >= 4) {
+        uint32_t a = crc ^ load32(p);
+        crc        = t[3][a >> 24] ^ t[2][(a >> 16) & 0xff] ^ t[1][(a >> 8) & 0xff] ^ t[0][a & 0xff];
+    }
+    return crc;
+}
+
+uint16_t crc16Ccitt(uint16_t crc, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const auto&    t = tables().ccitt;
+    for (; len >= 8; p += 8, len -= 8) {
+        crc = t[7][(crc >> 8) ^ p[0]] ^ t[6][(crc & 0xff) ^ p[1]] ^ t[5][p[2]] ^ t[4][p[3]] ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^
+              t[0][p[7]];
+    }
+    while (len--) {
+        crc = uint16_t(crc << 8) ^ t[0][(crc >> 8) ^ *p++];
+    }
+    return crc;
+}
+
+#ifdef HAVE_PCLMUL
+// Sixteen bytes of input.  For the STM32 CRC each 32-bit word is bit
+// reversed, which turns its MSB-first CRC into the reflected one.
+template <bool REVERSE>
+__attribute__((target("pclmul,sse4.1"))) static inline __m128i load128(const uint8_t* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    if (REVERSE) {
+        const __m128i nibbles = _mm_setr_epi8(0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf);
+        const __m128i words   = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m128i low     = _mm_set1_epi8(0x0f);
+        __m128i       lo      = _mm_shuffle_epi8(nibbles, _mm_and_si128(v, low));
+        __m128i       hi      = _mm_shuffle_epi8(nibbles, _mm_and_si128(_mm_srli_epi16(v, 4), low));
+        v                     = _mm_shuffle_epi8(_mm_or_si128(_mm_slli_epi16(lo, 4), hi), words);
+    }
+    return v;
+}
+
+// Folds a 128-bit lane forward over the 16 bytes after it
+__attribute__((target("pclmul,sse4.1"))) static inline __m128i fold16(__m128i x, __m128i k, __m128i next) {
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00)), next);
+}
+
+// Folds the reflected CRC-32 over `len` bytes, a multiple of 16 and at
+// least 64, as in Intel's "Fast CRC Computation for Generic Polynomials
+// Using PCLMULQDQ": four lanes fold 64 bytes a step, then fold into one,
+// and a Barrett reduction leaves the 32-bit remainder
+template <bool REVERSE>
+__attribute__((target("pclmul,sse4.1"))) static uint32_t foldPclmul(uint32_t crc, const uint8_t* p, size_t len) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5   = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_xor_si128(load128<REVERSE>(p), _mm_cvtsi32_si128(int(crc)));
+    __m128i x2 = load128<REVERSE>(p + 16);
+    __m128i x3 = load128<REVERSE>(p + 32);
+    __m128i x4 = load128<REVERSE>(p + 48);
+    for (p += 64, len -= 64; len >= 64; p += 64, len -= 64) {
+        x1 = fold16(x1, k1k2, load128<REVERSE>(p));
+        x2 = fold16(x2, k1k2, load128<REVERSE>(p + 16));
+        x3 = fold16(x3, k1k2, load128<REVERSE>(p + 32));
+        x4 = fold16(x4, k1k2, load128<REVERSE>(p + 48));
+    }
+
+    // Into 128 bits, then the remaining 16-byte blocks
+    x1 = fold16(fold16(fold16(x1, k3k4, x2), k3k4, x3), k3k4, x4);
+    for (; len >= 16; p += 16, len -= 16) {
+        x1 = fold16(x1, k3k4, load128<REVERSE>(p));
+    }
+
+    // 128 bits to 64, then to 32
+    x1        = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3k4, 0x10));
+    x1        = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5, 0x00));
+    __m128i q = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+    q         = _mm_clmulepi64_si128(_mm_and_si128(q, mask), poly, 0x00);
+    return uint32_t(_mm_extract_epi32(_mm_xor_si128(x1, q), 1));
+}
+
+static uint32_t crc32Pclmul(uint32_t crc, const uint8_t* p, size_t len) {
+    if (len >= 64) {
+        size_t n = len & ~size_t(15);
+        crc      = foldPclmul<false>(crc, p, n);
+        p += n;
+        len -= n;
+    }
+    return crc32Table(crc, p, len);
+}
+
+static uint32_t stm32Pclmul(uint32_t crc, const uint8_t* p, size_t len) {
+    if (len >= 64) {
+        size_t n = len & ~size_t(15);
+        crc      = reverseBits(foldPclmul<true>(reverseBits(crc), p, n));
+        p += n;
+        len -= n;
+    }
+    return stm32Table(crc, p, len);
+}
+
+static bool cpuHasPclmul() {
+    unsigned a, b, c, d;
+    return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_PCLMUL) && (c & bit_SSE4_1);
+}
+#endif
+
+#ifdef HAVE_ARM_CRC
+static uint32_t crc32Arm(uint32_t crc, const uint8_t* p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = __crc32d(crc, v);
+    }
+    while (len--) {
+        crc = __crc32b(crc, *p++);
+    }
+    return crc;
+}
+
+// The CRC32 instructions are reflected, so the register and each word
+// go in bit reversed; reversing two words at once also swaps them
+static uint32_t stm32Arm(uint32_t crc, const uint8_t* p, size_t len) {
+    crc = __rbit(crc);
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v   = __rbitll(v);
+        crc = __crc32d(crc, (v >> 32) | (v << 32));
+    }
+    if (len >= 4) {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        crc = __crc32w(crc, __rbit(w));
+    }
+    return __rbit(crc);
+}
+#endif
+
+using Kernel = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+struct Kernels {
+    Kernel      gzip;
+    Kernel      stm32;
+    const char* name;
+};
+
+static const Kernels& kernels() {
+    static const Kernels portable = { crc32Table, stm32Table, "slicing-by-8" };
+#if defined(HAVE_PCLMUL)
+    static const Kernels pclmul = { crc32Pclmul, stm32Pclmul, "PCLMULQDQ" };
+    static const Kernels& chosen = cpuHasPclmul() ? pclmul : portable;
+    return chosen;
+#elif defined(HAVE_ARM_CRC)
+    static const Kernels arm = { crc32Arm, stm32Arm, "ARMv8 CRC32" };
+    return arm;
+#else
+    return portable;
+#endif
+}
+
+uint32_t crc32(uint32_t crc, const void* data, size_t len) {
+    return ~kernels().gzip(~crc, static_cast<const uint8_t*>(data), len);
+}
+
+uint32_t crc32Stm32(uint32_t crc, const void* data, size_t len) {
+    return kernels().stm32(crc, static_cast<const uint8_t*>(data), len & ~size_t(3));
+}
+
+const char* crcImplementation() {
+    return kernels().name;
+}
+
+bool benchmarkChecksums(std::ostream& out) {
+    char text[120];
+    bool ok = true;
+    auto expect = [&](const char* what, uint32_t got, uint32_t want) {
+        if (got != want) {
+            snprintf(text, sizeof(text), "%s is %08x, not %08x", what, (unsigned)got, (unsigned)want);
+            out << text << std::endl;
+            ok = false;
+        }
+    };
+
+    // The catalogued check values, over "123456789".  The STM32 takes
+    // "4321" "8765" as "12345678", whose CRC-32/MPEG-2 is 49e3c2fb.
+    const uint8_t* check = reinterpret_cast<const uint8_t*>("123456789");
+    const uint8_t* words = reinterpret_cast<const uint8_t*>("43218765");
+    expect("CRC-16/XMODEM", crc16Ccitt(0, check, 9), 0x31c3);
+    expect("CRC-32 by table", ~crc32Table(~0u, check, 9), 0xcbf43926);
+    expect("CRC-32", crc32(0, check, 9), 0xcbf43926);
+    expect("STM32 CRC by table", stm32Table(0xffffffff, words, 8), 0x49e3c2fb);
+    expect("STM32 CRC", crc32Stm32(0xffffffff, words, 8), 0x49e3c2fb);
+
+    // The fast methods against the tables, at every alignment and over
+    // lengths either side of each block size, whole and in two pieces
+    std::vector<uint8_t> buffer(1 << 20);
+    std::mt19937         random(12345);
+    for (auto& byte : buffer) {
+        byte = uint8_t(random());
+    }
+    for (size_t offset = 0; offset < 16 && ok; ++offset) {
+        for (size_t len = 0; len < 600 && ok; len += len < 160 ? 1 : 37) {
+            const uint8_t* p     = buffer.data() + offset;
+            size_t         split = random() % (len + 1);
+            uint32_t       gzip  = ~crc32Table(~0u, p, len);
+            expect("CRC-32", crc32(0, p, len), gzip);
+            expect("CRC-32 in pieces", crc32(crc32(0, p, split), p + split, len - split), gzip);
+
+            uint32_t stm32 = stm32Table(0xffffffff, p, len & ~size_t(3));
+            split &= ~size_t(3);
+            expect("STM32 CRC", crc32Stm32(0xffffffff, p, len), stm32);
+            expect("STM32 CRC in pieces", crc32Stm32(crc32Stm32(0xffffffff, p, split), p + split, len - split), stm32);
+        }
+    }
+    if (!ok) {
+        return false;
+    }
+
+    struct Method {
+        const char*                                     name;
+        std::function<uint32_t(const uint8_t*, size_t)> run;
+    };
+    std::string         fast      = std::string("CRC-32 by ") + crcImplementation();
+    std::string         fastStm32 = std::string("STM32 CRC by ") + crcImplementation();
+    std::vector<Method> methods   = {
+        { "CRC-16/XMODEM", [](const uint8_t* p, size_t n) { return uint32_t(crc16Ccitt(0, p, n)); } },
+        { "CRC-32 by table", [](const uint8_t* p, size_t n) { return crc32Table(~0u, p, n); } },
+        { fast.c_str(), [](const uint8_t* p, size_t n) { return crc32(0, p, n); } },
+        { "STM32 CRC by table", [](const uint8_t* p, size_t n) { return stm32Table(0xffffffff, p, n); } },
+        { fastStm32.c_str(), [](const uint8_t* p, size_t n) { return crc32Stm32(0xffffffff, p, n); } },
+    };
+    if (kernels().gzip == crc32Table) {
+        methods.erase(methods.begin() + 4);
+        methods.erase(methods.begin() + 2);
+    }
+
+    const int         passes = 256;
+    volatile uint32_t sink   = 0;
+    for (auto& method : methods) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < passes; ++i) {
+            sink = sink + method.run(buffer.data(), buffer.size());
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        snprintf(text, sizeof(text), "%-24s %6.2f GB/s", method.name, seconds > 0 ? passes * double(buffer.size()) / seconds / 1e9 : 0.0);
+        out << text << std::endl;
+    }
+    return true;
+}
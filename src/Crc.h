@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// The checksums FluidTerm computes.  Each continues from `crc`, so a
+// long run can be taken in pieces.  The CRC-32s fold 64 bytes at a time
+// with PCLMULQDQ on x86 CPUs that have it, or use the ARMv8 CRC32
+// instructions; everything else goes eight bytes at a time by table.
+
+// CRC-16/XMODEM, as used by XModem and YModem packets (0 to start)
+uint16_t crc16Ccitt(uint16_t crc, const void* data, size_t len);
+
+// The gzip CRC-32 of `len` bytes, continuing from `crc` (0 to start)
+uint32_t crc32(uint32_t crc, const void* data, size_t len);
+
+// The CRC an STM32 computes over memory: CRC-32/MPEG-2 fed one little
+// endian 32-bit word at a time, MSB first (0xFFFFFFFF to start).  `len`
+// is a multiple of 4; any bytes beyond the last whole word are ignored.
+uint32_t crc32Stm32(uint32_t crc, const void* data, size_t len);
+
+// The CRC-32 method in use, for reports
+const char* crcImplementation();
+
+// Checks every method against known values and each other, then reports
+// their speeds.  False if any check fails.
+bool benchmarkChecksums(std::ostream& out);
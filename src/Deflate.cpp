@@ -0,0 +1,577 @@
+#include "Deflate.h"
+#include "Crc.h"
+#include "Inflate.h"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <queue>
+#include <vector>
+
+static const uint16_t lengthBase[29]  = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                          31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t  lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30]    = { 1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                          193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t  distExtra[30]   = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// The order code length code lengths are sent in
+static const uint8_t clOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static const size_t WINDOW        = 32768;
+static const size_t MAX_MATCH     = 258;
+static const int    HASH_BITS     = 15;
+static const int    MAX_CHAIN     = 64;     // candidates tried per position
+static const size_t LAZY_LIMIT    = 32;     // matches this long are taken without looking ahead
+static const size_t NICE_MATCH    = 128;    // matches this long end the search
+static const size_t TOO_FAR       = 4096;   // 3-byte matches further back cost more than literals
+static const size_t BLOCK_SYMBOLS = 16384;  // symbols per Huffman block
+
+// Length and distance to code lookups, as zlib does it
+struct CodeTables {
+    uint8_t length[MAX_MATCH + 1];
+    uint8_t dist[512];  // by distance - 1 below 256, else 256 + ((distance - 1) >> 7)
+
+    CodeTables() {
+        for (int code = 0; code < 29; ++code) {
+            for (int i = 0; i < 1 << lengthExtra[code]; ++i) {
+                length[lengthBase[code] + i] = code;
+            }
+        }
+        for (int code = 0; code < 30; ++code) {
+            for (int i = 0; i < 1 << distExtra[code]; ++i) {
+                int d = distBase[code] - 1 + i;
+                if (d < 256) {
+                    dist[d] = code;
+                } else {
+                    dist[256 + (d >> 7)] = code;
+                }
+            }
+        }
+    }
+
+    int distCode(int distance) const {
+        int d = distance - 1;
+        return d < 256 ? dist[d] : dist[256 + (d >> 7)];
+    }
+};
+
+static const CodeTables codeTables;
+
+// Writes bits least significant first
+class BitWriter {
+private:
+    std::string& m_out;
+    uint64_t     m_bits  = 0;
+    int          m_nbits = 0;
+
+public:
+    explicit BitWriter(std::string& out) : m_out(out) {}
+
+    void put(uint32_t value, int n) {
+        m_bits |= uint64_t(value) << m_nbits;
+        m_nbits += n;
+        while (m_nbits >= 8) {
+            m_out += char(m_bits);
+            m_bits >>= 8;
+            m_nbits -= 8;
+        }
+    }
+    void align() {
+        if (m_nbits) {
+            put(0, 8 - m_nbits);
+        }
+    }
+    // Call when aligned
+    void bytes(const uint8_t* p, size_t len) { m_out.append(reinterpret_cast<const char*>(p), len); }
+};
+
+// A literal byte when dist is 0, else a match
+struct Symbol {
+    uint16_t len;
+    uint16_t dist;
+};
+
+// Huffman code lengths for the frequencies, none longer than `limit`.
+// If the tree comes out too deep, the frequencies are flattened and it
+// is built again.  At least two symbols get codes, so the code is
+// complete even when fewer are used.
+static void huffmanLengths(const uint32_t* freq, int n, int limit, uint8_t* lengths) {
+    std::vector<uint32_t> weight(freq, freq + n);
+    while (true) {
+        std::fill(lengths, lengths + n, 0);
+        std::vector<int> used;
+        for (int i = 0; i < n; ++i) {
+            if (weight[i]) {
+                used.push_back(i);
+            }
+        }
+        if (used.size() < 2) {
+            int first              = used.empty() ? 0 : used[0];
+            lengths[first]         = 1;
+            lengths[first ? 0 : 1] = 1;
+            return;
+        }
+
+        // Nodes are the used symbols, then the internal nodes in order of
+        // creation, so every parent comes after its children
+        typedef std::pair<uint64_t, int>                                    Entry;
+        std::vector<uint64_t>                                               w;
+        std::vector<int>                                                    parent(2 * used.size() - 1, -1);
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+        for (int symbol : used) {
+            heap.push({ weight[symbol], int(w.size()) });
+            w.push_back(weight[symbol]);
+        }
+        while (heap.size() > 1) {
+            Entry a = heap.top();
+            heap.pop();
+            Entry b = heap.top();
+            heap.pop();
+            int node         = int(w.size());
+            parent[a.second] = node;
+            parent[b.second] = node;
+            w.push_back(a.first + b.first);
+            heap.push({ a.first + b.first, node });
+        }
+
+        std::vector<int> depth(w.size(), 0);
+        int              deepest = 0;
+        for (int node = int(w.size()) - 2; node >= 0; --node) {
+            depth[node] = depth[parent[node]] + 1;
+            deepest     = std::max(deepest, depth[node]);
+        }
+        if (deepest <= limit) {
+            for (size_t i = 0; i < used.size(); ++i) {
+                lengths[used[i]] = depth[i];
+            }
+            return;
+        }
+        for (auto& x : weight) {
+            if (x) {
+                x = (x >> 1) | 1;
+            }
+        }
+    }
+}
+
+// Canonical codes for the lengths, bit-reversed for a BitWriter
+static void huffmanCodes(const uint8_t* lengths, int n, uint16_t* codes) {
+    uint16_t count[16] = { 0 };
+    uint16_t next[16];
+    for (int i = 0; i < n; ++i) {
+        ++count[lengths[i]];
+    }
+    count[0]      = 0;
+    uint16_t code = 0;
+    for (int bits = 1; bits < 16; ++bits) {
+        code       = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < n; ++i) {
+        int len = lengths[i];
+        if (len) {
+            uint16_t c   = next[len]++;
+            uint16_t rev = 0;
+            for (int b = 0; b < len; ++b) {
+                rev = (rev << 1) | ((c >> b) & 1);
+            }
+            codes[i] = rev;
+        }
+    }
+}
+
+// Writes the symbols as one block with codes built for them, or the raw
+// bytes they came from as stored blocks if that is smaller
+static void writeBlock(BitWriter& out, const std::vector<Symbol>& symbols, const uint8_t* raw, size_t rawLen, bool last) {
+    uint32_t litFreq[286] = { 0 };
+    uint32_t distFreq[30] = { 0 };
+    uint64_t extraBits    = 0;
+    for (auto& s : symbols) {
+        if (s.dist == 0) {
+            ++litFreq[s.len];
+        } else {
+            int lc = codeTables.length[s.len];
+            int dc = codeTables.distCode(s.dist);
+            ++litFreq[257 + lc];
+            ++distFreq[dc];
+            extraBits += lengthExtra[lc] + distExtra[dc];
+        }
+    }
+    litFreq[256] = 1;
+
+    uint8_t litLen[286];
+    uint8_t distLen[30];
+    huffmanLengths(litFreq, 286, 15, litLen);
+    huffmanLengths(distFreq, 30, 15, distLen);
+    int hlit = 286;
+    while (hlit > 257 && !litLen[hlit - 1]) {
+        --hlit;
+    }
+    int hdist = 30;
+    while (hdist > 1 && !distLen[hdist - 1]) {
+        --hdist;
+    }
+
+    // Run-length code the two length tables as one sequence
+    std::vector<uint8_t> lens(litLen, litLen + hlit);
+    lens.insert(lens.end(), distLen, distLen + hdist);
+    std::vector<std::pair<uint8_t, uint8_t>> runs;  // code length symbol, extra bits value
+    for (size_t i = 0; i < lens.size();) {
+        uint8_t len = lens[i];
+        size_t  run = 1;
+        while (i + run < lens.size() && lens[i + run] == len) {
+            ++run;
+        }
+        i += run;
+        if (len == 0) {
+            while (run >= 11) {
+                size_t n = std::min<size_t>(run, 138);
+                runs.push_back({ 18, uint8_t(n - 11) });
+                run -= n;
+            }
+            if (run >= 3) {
+                runs.push_back({ 17, uint8_t(run - 3) });
+                run = 0;
+            }
+        } else {
+            runs.push_back({ len, 0 });
+            --run;
+            while (run >= 3) {
+                size_t n = std::min<size_t>(run, 6);
+                runs.push_back({ 16, uint8_t(n - 3) });
+                run -= n;
+            }
+        }
+        while (run--) {
+            runs.push_back({ len, 0 });
+        }
+    }
+    uint32_t clFreq[19] = { 0 };
+    for (auto& r : runs) {
+        ++clFreq[r.first];
+    }
+    uint8_t clLen[19];
+    huffmanLengths(clFreq, 19, 7, clLen);
+    int hclen = 19;
+    while (hclen > 4 && !clLen[clOrder[hclen - 1]]) {
+        --hclen;
+    }
+
+    static const uint8_t runExtra[19] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+    uint64_t             dynamicBits  = 3 + 14 + 3 * hclen + extraBits;
+    for (auto& r : runs) {
+        dynamicBits += clLen[r.first] + runExtra[r.first];
+    }
+    for (int i = 0; i < 286; ++i) {
+        dynamicBits += uint64_t(litFreq[i]) * litLen[i];
+    }
+    for (int i = 0; i < 30; ++i) {
+        dynamicBits += uint64_t(distFreq[i]) * distLen[i];
+    }
+    uint64_t storedBits = rawLen * 8 + (rawLen / 65535 + 1) * (3 + 7 + 32);
+
+    if (storedBits < dynamicBits) {
+        do {
+            size_t n = std::min<size_t>(rawLen, 65535);
+            out.put(last && n == rawLen, 1);
+            out.put(0, 2);
+            out.align();
+            out.put(uint32_t(n), 16);
+            out.put(uint32_t(~n & 0xffff), 16);
+            out.bytes(raw, n);
+            raw += n;
+            rawLen -= n;
+        } while (rawLen);
+        return;
+    }
+
+    uint16_t litCode[286];
+    uint16_t distCode[30];
+    uint16_t clCode[19];
+    huffmanCodes(litLen, 286, litCode);
+    huffmanCodes(distLen, 30, distCode);
+    huffmanCodes(clLen, 19, clCode);
+
+    out.put(last, 1);
+    out.put(2, 2);
+    out.put(hlit - 257, 5);
+    out.put(hdist - 1, 5);
+    out.put(hclen - 4, 4);
+    for (int i = 0; i < hclen; ++i) {
+        out.put(clLen[clOrder[i]], 3);
+    }
+    for (auto& r : runs) {
+        out.put(clCode[r.first], clLen[r.first]);
+        if (runExtra[r.first]) {
+            out.put(r.second, runExtra[r.first]);
+        }
+    }
+    for (auto& s : symbols) {
+        if (s.dist == 0) {
+            out.put(litCode[s.len], litLen[s.len]);
+        } else {
+            int lc = codeTables.length[s.len];
+            int dc = codeTables.distCode(s.dist);
+            out.put(litCode[257 + lc], litLen[257 + lc]);
+            out.put(s.len - lengthBase[lc], lengthExtra[lc]);
+            out.put(distCode[dc], distLen[dc]);
+            out.put(s.dist - distBase[dc], distExtra[dc]);
+        }
+    }
+    out.put(litCode[256], litLen[256]);
+}
+
+// How many bytes match, up to `maxLen`, comparing eight at a time
+static size_t matchLength(const uint8_t* a, const uint8_t* b, size_t maxLen) {
+    size_t n = 0;
+    while (n + 8 <= maxLen) {
+        uint64_t x, y;
+        memcpy(&x, a + n, 8);
+        memcpy(&y, b + n, 8);
+        if (x != y) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return n + (__builtin_ctzll(x ^ y) >> 3);
+#else
+            break;
+#endif
+        }
+        n += 8;
+    }
+    while (n < maxLen && a[n] == b[n]) {
+        ++n;
+    }
+    return n;
+}
+
+void deflateBlock(const uint8_t* data, size_t len, size_t dictLen, bool last, std::string& out) {
+    // Positions are relative to the start of the dictionary
+    const uint8_t*       base  = data - dictLen;
+    size_t               end   = dictLen + len;
+    std::vector<int32_t> head(1 << HASH_BITS, -1);
+    std::vector<int32_t> prev(end);
+
+    auto insert = [&](size_t i) {
+        if (i + 3 <= end) {
+            uint32_t h = ((base[i] << 10) ^ (base[i + 1] << 5) ^ base[i + 2]) & ((1 << HASH_BITS) - 1);
+            prev[i]    = head[h];
+            head[h]    = int32_t(i);
+        }
+    };
+    auto longest = [&](size_t i, size_t& bestLen, size_t& bestDist) {
+        bestLen = 0;
+        if (i + 3 > end) {
+            return;
+        }
+        uint32_t h      = ((base[i] << 10) ^ (base[i + 1] << 5) ^ base[i + 2]) & ((1 << HASH_BITS) - 1);
+        size_t   maxLen = std::min(MAX_MATCH, end - i);
+        int      chain  = MAX_CHAIN;
+        for (int32_t cand = head[h]; cand >= 0 && i - cand <= WINDOW && chain--; cand = prev[cand]) {
+            const uint8_t* a = base + cand;
+            const uint8_t* b = base + i;
+            if (a[bestLen] != b[bestLen] || a[0] != b[0]) {
+                continue;
+            }
+            size_t n = matchLength(a, b, maxLen);
+            if (n > bestLen) {
+                bestLen  = n;
+                bestDist = i - cand;
+                if (n >= NICE_MATCH) {
+                    break;
+                }
+            }
+        }
+        if (bestLen < 3 || (bestLen == 3 && bestDist > TOO_FAR)) {
+            bestLen = 0;
+        }
+    };
+
+    for (size_t i = dictLen > WINDOW ? dictLen - WINDOW : 0; i < dictLen; ++i) {
+        insert(i);
+    }
+
+    BitWriter           writer(out);
+    std::vector<Symbol> symbols;
+    symbols.reserve(BLOCK_SYMBOLS + 1);
+    size_t blockStart = dictLen;
+    size_t i          = dictLen;
+    while (i < end) {
+        size_t len, dist;
+        longest(i, len, dist);
+        insert(i);
+        if (len && len < LAZY_LIMIT) {
+            // Defer to a longer match starting at the next byte
+            size_t nextLen, nextDist;
+            longest(i + 1, nextLen, nextDist);
+            if (nextLen > len) {
+                len = 0;
+            }
+        }
+        if (len) {
+            symbols.push_back({ uint16_t(len), uint16_t(dist) });
+            for (size_t j = i + 1; j < i + len; ++j) {
+                insert(j);
+            }
+            i += len;
+        } else {
+            symbols.push_back({ base[i], 0 });
+            ++i;
+        }
+        if (symbols.size() >= BLOCK_SYMBOLS && i < end) {
+            writeBlock(writer, symbols, base + blockStart, i - blockStart, false);
+            symbols.clear();
+            blockStart = i;
+        }
+    }
+    writeBlock(writer, symbols, base + blockStart, end - blockStart, last);
+    if (!last) {
+        // An empty stored block, as a zlib sync flush writes
+        writer.put(0, 3);
+        writer.align();
+        writer.put(0, 16);
+        writer.put(0xffff, 16);
+    }
+    writer.align();
+}
+
+GzipCompressor::GzipCompressor(std::istream& in, unsigned threads) :
+    m_in(in), m_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), m_length(0), m_inLength(0), m_piece(0),
+    m_offset(0), m_end(false), m_error(false), m_stop(false) {
+    setg(nullptr, nullptr, nullptr);
+    m_worker = std::thread(&GzipCompressor::compress, this);
+}
+
+GzipCompressor::~GzipCompressor() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_worker.join();
+}
+
+void GzipCompressor::publish(std::string&& piece) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_length += piece.length();
+    m_pieces.push_back(std::move(piece));
+    m_changed.notify_all();
+}
+
+void GzipCompressor::compress() {
+    // Header: deflate, no flags or time, unknown OS
+    publish(std::string("\x1f\x8b\x08\0\0\0\0\0\0\xff", 10));
+
+    std::deque<std::future<std::string>> pending;
+    std::vector<uint8_t>                 window;  // the input just before the next piece
+    uint32_t                             crc   = 0;
+    uint64_t                             total = 0;
+    bool                                 last  = false;
+    while (!last) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop) {
+                break;
+            }
+        }
+        auto data = std::make_shared<std::vector<uint8_t>>(window.size() + CHUNK);
+        std::copy(window.begin(), window.end(), data->begin());
+        m_in.read(reinterpret_cast<char*>(data->data() + window.size()), CHUNK);
+        size_t got = size_t(m_in.gcount());
+        last       = got < CHUNK;
+        if (m_in.bad()) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_error = true;
+            break;
+        }
+        data->resize(window.size() + got);
+        crc = crc32(crc, data->data() + window.size(), got);
+        total += got;
+
+        size_t dictLen = window.size();
+        window.assign(data->end() - std::min(data->size(), WINDOW), data->end());
+        pending.push_back(std::async(std::launch::async, [data, dictLen, last]() {
+            std::string out;
+            deflateBlock(data->data() + dictLen, data->size() - dictLen, dictLen, last, out);
+            return out;
+        }));
+        while (pending.size() >= m_threads || (last && pending.size())) {
+            publish(pending.front().get());
+            pending.pop_front();
+        }
+    }
+    while (pending.size()) {
+        pending.front().wait();
+        pending.pop_front();
+    }
+
+    std::string trailer;
+    for (int i = 0; i < 4; ++i) {
+        trailer += char(crc >> (8 * i));
+    }
+    for (int i = 0; i < 4; ++i) {
+        trailer += char(total >> (8 * i));
+    }
+    if (last) {
+        publish(std::move(trailer));
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_inLength = total;
+    m_end      = true;
+    m_changed.notify_all();
+}
+
+int64_t GzipCompressor::size() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [this] { return m_end; });
+    return m_error ? -1 : int64_t(m_length);
+}
+
+GzipCompressor::int_type GzipCompressor::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_changed.wait(lock, [this] { return m_piece < m_pieces.size() || m_end; });
+        if (m_piece >= m_pieces.size()) {
+            return traits_type::eof();
+        }
+        if (eback()) {
+            m_offset += m_pieces[m_piece - 1].length();
+        }
+        // Pieces stay put once added, so the pointers outlive the lock
+        std::string& piece = m_pieces[m_piece++];
+        char*        p     = &piece[0];
+        setg(p, p, p + piece.length());
+        if (piece.length()) {
+            return traits_type::to_int_type(*p);
+        }
+    }
+}
+
+GzipCompressor::pos_type GzipCompressor::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    if (dir == std::ios_base::cur) {
+        off += m_offset + (gptr() - eback());
+    } else if (dir == std::ios_base::end) {
+        off += size();
+    }
+    return seekpos(pos_type(off), which);
+}
+
+GzipCompressor::pos_type GzipCompressor::seekpos(pos_type pos, std::ios_base::openmode) {
+    uint64_t                     target = uint64_t(std::streamoff(pos));
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [this, target] { return m_length > target || m_end; });
+    if (target > m_length) {
+        return pos_type(off_type(-1));
+    }
+    uint64_t offset = 0;
+    size_t   piece  = 0;
+    while (piece + 1 < m_pieces.size() && offset + m_pieces[piece].length() <= target) {
+        offset += m_pieces[piece++].length();
+    }
+    std::string& p = m_pieces[piece];
+    setg(&p[0], &p[0] + (target - offset), &p[0] + p.length());
+    m_piece  = piece + 1;
+    m_offset = offset;
+    return pos;
+}
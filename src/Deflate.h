@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+// Compresses `len` bytes at `data` to raw deflate (RFC 1951), appending
+// to `out`.  The `dictLen` bytes before `data` are earlier input that
+// matches may refer back to.  With `last` the output ends the stream;
+// otherwise it ends with an empty stored block on a byte boundary, so
+// the next piece can simply be appended.
+void deflateBlock(const uint8_t* data, size_t len, size_t dictLen, bool last, std::string& out);
+
+// Gzips a stream on a background thread, reading out as a streambuf.
+// Large inputs are cut into CHUNK pieces that are deflated in parallel,
+// each primed with the 32K before it as pigz does, so the ratio is
+// within a fraction of a percent of a single stream.  The output is the
+// same whatever the number of threads.  The reader blocks only until
+// the piece it needs is done; the compressed data is kept, so it can be
+// reread after seeking.  The input stream must not be used until
+// size() has returned.
+class GzipCompressor : public std::streambuf {
+public:
+    static const size_t CHUNK = 1 << 20;
+
+private:
+    std::istream&           m_in;
+    unsigned                m_threads;
+    std::deque<std::string> m_pieces;  // the compressed output in order
+    uint64_t                m_length;  // total length of m_pieces
+    uint64_t                m_inLength;
+    size_t                  m_piece;   // next piece for underflow()
+    uint64_t                m_offset;  // output offset of the piece being read
+    bool                    m_end;
+    bool                    m_error;
+    bool                    m_stop;
+    std::mutex              m_mutex;
+    std::condition_variable m_changed;
+    std::thread             m_worker;
+
+    void compress();
+    void publish(std::string&& piece);
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+public:
+    // With no thread count, uses one per core
+    explicit GzipCompressor(std::istream& in, unsigned threads = 0);
+    ~GzipCompressor();
+
+    // Waits for the compression to finish.  Returns the compressed
+    // size, or -1 if reading the input failed.
+    int64_t size();
+
+    // The uncompressed size, once size() has returned
+    uint64_t inputSize() const { return m_inLength; }
+};
@@ -0,0 +1,417 @@
+#include "DrillOptimizer.h"
+#include "GCode.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Point {
+    double x, y;
+};
+
+static double dist(const Point& a, const Point& b) {
+    return std::hypot(a.x - b.x, a.y - b.y);
+}
+
+static double pathLength(const Point& start, const std::vector<Point>& holes, const std::vector<int>& order) {
+    double      len = 0;
+    const Point* p  = &start;
+    for (int h : order) {
+        len += dist(*p, holes[h]);
+        p = &holes[h];
+    }
+    return len;
+}
+
+static const int    NEIGHBORS        = 8;
+static const size_t THREAD_THRESHOLD = 512;
+
+// The K nearest neighbours of every hole, K per row.  This is the
+// quadratic part of the search, so large sets are split across cores.
+static int nearestNeighbors(const std::vector<Point>& holes, std::vector<int>& neighbors) {
+    size_t n = holes.size();
+    int    k = int(std::min<size_t>(NEIGHBORS, n - 1));
+    neighbors.assign(n * k, 0);
+
+    auto work = [&](size_t first, size_t last) {
+        std::vector<std::pair<double, int>> candidates;
+        candidates.reserve(n);
+        for (size_t i = first; i < last; ++i) {
+            candidates.clear();
+            for (size_t j = 0; j < n; ++j) {
+                if (j != i) {
+                    double dx = holes[i].x - holes[j].x;
+                    double dy = holes[i].y - holes[j].y;
+                    candidates.emplace_back(dx * dx + dy * dy, int(j));
+                }
+            }
+            std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end());
+            for (int m = 0; m < k; ++m) {
+                neighbors[i * k + m] = candidates[m].second;
+            }
+        }
+    };
+
+    size_t nthreads = n < THREAD_THRESHOLD ? 1 : std::max(1u, std::thread::hardware_concurrency());
+    if (nthreads == 1) {
+        work(0, n);
+        return k;
+    }
+    std::vector<std::thread> threads;
+    size_t                   chunk = (n + nthreads - 1) / nthreads;
+    for (size_t first = 0; first < n; first += chunk) {
+        threads.emplace_back(work, first, std::min(n, first + chunk));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return k;
+}
+
+static void nearestNeighborTour(const Point& start, const std::vector<Point>& holes, std::vector<int>& order) {
+    size_t            n = holes.size();
+    std::vector<bool> visited(n, false);
+    order.clear();
+    Point p = start;
+    for (size_t step = 0; step < n; ++step) {
+        int    best     = -1;
+        double bestDist = 0;
+        for (size_t j = 0; j < n; ++j) {
+            if (!visited[j]) {
+                double d = dist(p, holes[j]);
+                if (best < 0 || d < bestDist) {
+                    best     = int(j);
+                    bestDist = d;
+                }
+            }
+        }
+        visited[best] = true;
+        order.push_back(best);
+        p = holes[best];
+    }
+}
+
+// 2-opt on an open path with fixed ends, trying only moves that create
+// an edge to one of a hole's nearest neighbours.
+static void twoOpt(const Point& start, const Point& end, const std::vector<Point>& holes, std::vector<int>& order) {
+    int              n = int(order.size());
+    std::vector<int> neighbors;
+    int              k = nearestNeighbors(holes, neighbors);
+    std::vector<int> pos(n);
+    for (int i = 0; i < n; ++i) {
+        pos[order[i]] = i;
+    }
+    auto pt = [&](int i) -> const Point& { return i < 0 ? start : (i < n ? holes[order[i]] : end); };
+
+    // Reversing order[l..r] replaces edges (l-1,l) and (r,r+1) with (l-1,r) and (l,r+1)
+    auto tryReverse = [&](int l, int r) {
+        if (l >= r) {
+            return false;
+        }
+        double delta = dist(pt(l - 1), pt(r)) - dist(pt(l - 1), pt(l)) + dist(pt(l), pt(r + 1)) - dist(pt(r), pt(r + 1));
+        if (delta > -1e-9) {
+            return false;
+        }
+        std::reverse(order.begin() + l, order.begin() + r + 1);
+        for (int i = l; i <= r; ++i) {
+            pos[order[i]] = i;
+        }
+        return true;
+    };
+
+    bool improved = true;
+    for (int pass = 0; improved && pass < 100; ++pass) {
+        improved = false;
+        for (int a = 0; a < n; ++a) {
+            // Connect the start or the end to this hole
+            improved |= tryReverse(0, pos[a]);
+            improved |= tryReverse(pos[a], n - 1);
+            for (int m = 0; m < k; ++m) {
+                int i = pos[a];
+                int j = pos[neighbors[a * k + m]];
+                improved |= j > i ? tryReverse(i + 1, j) : tryReverse(j + 1, i);
+            }
+        }
+    }
+}
+
+// A run of holes that may be visited in any order
+struct Run {
+    bool                canned;
+    size_t              first, last;  // line range
+    Point               start;        // tool position before the run
+    double              clearZ;       // plunge blocks start and end here
+    bool                inches;
+    std::string         header;       // canned: the non-XY words of the first line
+    std::vector<Point>  holes;
+    std::vector<size_t> blockFirst;   // plunge blocks: line range of each hole
+    std::vector<size_t> blockLast;
+    std::vector<double> feeds;        // plunge blocks: feed at the first plunge
+    double              entryFeed;
+};
+
+static bool onlyLetters(const GCodeBlock& block, const char* letters) {
+    for (int i = 0; i < block.nwords; ++i) {
+        if (!strchr(letters, block.words[i].letter)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isCannedWord(const GCodeWord& w) {
+    return w.letter == 'G' && w.value >= 81 && w.value <= 89;
+}
+
+// The job's lines, read as they are asked for.  Lines before the one
+// being matched are written out and dropped, so only a run and the
+// lines looked ahead at are held.
+class LineWindow {
+private:
+    std::istream&           m_in;
+    std::deque<std::string> m_lines;
+    size_t                  m_base = 0;  // index of m_lines.front()
+
+public:
+    explicit LineWindow(std::istream& in) : m_in(in) {}
+
+    // Line i, or nullptr past the end
+    const std::string* at(size_t i) {
+        while (i >= m_base + m_lines.size()) {
+            std::string line;
+            if (!std::getline(m_in, line)) {
+                return nullptr;
+            }
+            if (line.length() && line.back() == '\r') {
+                line.pop_back();
+            }
+            m_lines.push_back(std::move(line));
+        }
+        return &m_lines[i - m_base];
+    }
+
+    // Forgets the lines before `to`
+    void drop(size_t to) {
+        while (m_base < to && m_lines.size()) {
+            m_lines.pop_front();
+            ++m_base;
+        }
+    }
+
+    // Writes lines [from, to), then forgets them
+    void copy(size_t from, size_t to, std::ostream& out) {
+        for (size_t i = from; i < to; ++i) {
+            out << *at(i) << '\n';
+        }
+        drop(to);
+    }
+};
+
+// Matches "G0 X Y", Z-only moves that go down, and a G0 back to the
+// starting Z.  On success `end` is one past the block and `after` is
+// the state following it.
+static bool matchPlungeBlock(LineWindow& lines, size_t i, const GCodeState& state, size_t& end, GCodeState& after, double& feed) {
+    GCodeBlock  block;
+    double      from[3];
+    const auto& line = *lines.at(i);
+    if (!parseGCode(line.c_str(), line.length(), block) || !block.hasG(0) || block.has('Z') || !onlyLetters(block, "GXY") ||
+        !(block.has('X') || block.has('Y'))) {
+        return false;
+    }
+    GCodeState s = state;
+    s.update(block, from);
+    if (!s.absolute || s.motion != 0) {
+        return false;
+    }
+    double z0   = s.pos[2];
+    bool   down = false;
+    feed        = -1;
+    for (size_t j = i + 1;; ++j) {
+        const std::string* l = lines.at(j);
+        if (!l || !parseGCode(l->c_str(), l->length(), block) || !block.has('Z') || !onlyLetters(block, "GZF")) {
+            return false;
+        }
+        for (int w = 0; w < block.nwords; ++w) {
+            if (block.words[w].letter == 'G' && block.words[w].value != 0 && block.words[w].value != 1) {
+                return false;
+            }
+        }
+        s.update(block, from);
+        if (s.motion == 1 && feed < 0) {
+            feed = s.feed;
+        }
+        if (s.pos[2] < z0 - 1e-6) {
+            down = true;
+        } else if (down && s.motion == 0 && std::fabs(s.pos[2] - z0) < 1e-6) {
+            end   = j + 1;
+            after = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void writeNumberWord(std::ostream& out, char letter, double value) {
+    std::string word;
+    appendWord(word, letter, value);
+    out << word;
+}
+
+// Writes the run in a shorter order if one is found, otherwise as it was
+static void emitRun(LineWindow& lines, const Run& run, std::ostream& out, DrillStats& stats) {
+    std::vector<int> order(run.holes.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = int(i);
+    }
+    double before = pathLength(run.start, run.holes, order);
+
+    bool uniformFeed = std::all_of(run.feeds.begin(), run.feeds.end(), [&](double f) { return f == run.feeds[0]; });
+    if (run.holes.size() >= 3 && uniformFeed) {
+        // The last hole stays last, so the lines after the run start
+        // from where they did
+        std::vector<Point> inner(run.holes.begin(), run.holes.end() - 1);
+        std::vector<int>   better;
+        nearestNeighborTour(run.start, inner, better);
+        twoOpt(run.start, run.holes.back(), inner, better);
+        better.push_back(int(inner.size()));
+        double after = pathLength(run.start, run.holes, better);
+        if (after < before - 1e-6) {
+            double scale = run.inches ? 25.4 : 1;
+            stats.holes += run.holes.size();
+            stats.runs++;
+            stats.before += before * scale;
+            stats.after += after * scale;
+            order = better;
+        }
+    }
+
+    if (run.canned) {
+        bool first = true;
+        for (int h : order) {
+            if (first && run.header.length()) {
+                out << run.header << ' ';
+            }
+            first = false;
+            writeNumberWord(out, 'X', run.holes[h].x);
+            out << ' ';
+            writeNumberWord(out, 'Y', run.holes[h].y);
+            out << '\n';
+        }
+        return;
+    }
+    if (order[0] != 0 && run.feeds.size() && run.feeds[0] >= 0 && run.feeds[0] != run.entryFeed) {
+        // The feed was set inside the first block, which may have moved
+        writeNumberWord(out, 'F', run.feeds[0]);
+        out << '\n';
+    }
+    for (int h : order) {
+        for (size_t l = run.blockFirst[h]; l < run.blockLast[h]; ++l) {
+            out << *lines.at(l) << '\n';
+        }
+    }
+}
+
+void optimizeDrilling(std::istream& in, std::ostream& out, double rapid, DrillStats& stats) {
+    stats = DrillStats { 0, 0, 0, 0, 0 };
+
+    LineWindow lines(in);
+    GCodeState state;
+    GCodeBlock block;
+    Run        run;
+    bool       inRun  = false;
+    size_t     copied = 0;
+
+    auto flush = [&]() {
+        if (!inRun) {
+            return;
+        }
+        lines.copy(copied, run.first, out);
+        emitRun(lines, run, out, stats);
+        lines.drop(run.last);
+        copied = run.last;
+        inRun  = false;
+    };
+    auto begin = [&](bool canned, size_t first) {
+        flush();
+        run            = Run();
+        run.canned     = canned;
+        run.first      = first;
+        run.start      = { state.pos[0], state.pos[1] };
+        run.clearZ     = state.pos[2];
+        run.inches     = state.inches;
+        run.entryFeed  = state.feed;
+        inRun          = true;
+    };
+
+    for (size_t i = 0; lines.at(i);) {
+        if (!inRun) {
+            lines.copy(copied, i, out);
+            copied = i;
+        }
+        const auto& line = *lines.at(i);
+        if (!parseGCode(line.c_str(), line.length(), block)) {
+            flush();
+            ++i;
+            continue;
+        }
+        GCodeState next = state;
+        double     from[3];
+        next.update(block, from);
+
+        bool xy = block.has('X') || block.has('Y');
+        if (next.motion >= 81 && next.motion <= 89 && next.absolute && xy && next.isMotion(block) && !block.has('L')) {
+            bool bare = onlyLetters(block, "XY");
+            if (!(bare && inRun && run.canned && run.inches == next.inches)) {
+                begin(true, i);
+                for (int w = 0; w < block.nwords; ++w) {
+                    const GCodeWord& word = block.words[w];
+                    if (word.letter != 'X' && word.letter != 'Y') {
+                        if (run.header.length()) {
+                            run.header += ' ';
+                        }
+                        appendWord(run.header, word.letter, word.value);
+                    }
+                }
+            }
+            run.holes.push_back({ next.pos[0], next.pos[1] });
+            run.last = i + 1;
+            state    = next;
+            ++i;
+            continue;
+        }
+
+        size_t     end;
+        GCodeState after;
+        double     feed;
+        if (matchPlungeBlock(lines, i, state, end, after, feed)) {
+            if (!(inRun && !run.canned && std::fabs(state.pos[2] - run.clearZ) < 1e-6 && run.inches == state.inches)) {
+                begin(false, i);
+            }
+            GCodeState atHole = state;
+            parseGCode(line.c_str(), line.length(), block);
+            atHole.update(block, from);
+            run.holes.push_back({ atHole.pos[0], atHole.pos[1] });
+            run.blockFirst.push_back(i);
+            run.blockLast.push_back(end);
+            run.feeds.push_back(feed);
+            run.last = end;
+            state    = after;
+            i        = end;
+            continue;
+        }
+
+        flush();
+        state = next;
+        ++i;
+    }
+    flush();
+    for (; lines.at(copied); ++copied) {
+        lines.copy(copied, copied + 1, out);
+    }
+
+    if (rapid > 0) {
+        stats.seconds = (stats.before - stats.after) / rapid * 60;
+    }
+}
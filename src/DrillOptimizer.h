@@ -0,0 +1,19 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+
+struct DrillStats {
+    size_t holes;     // holes in reordered runs
+    size_t runs;      // runs of independent holes that were reordered
+    double before;    // rapid travel in mm, original order
+    double after;     // rapid travel in mm, optimized order
+    double seconds;   // estimated time saved at the rapid rate
+};
+
+// Reorders independent hole operations to shorten rapid travel.  A run
+// of holes is either a canned cycle (G81-G89) followed by bare XY
+// lines, or consecutive "G0 XY, Z-only plunges, G0 Z back up" blocks.
+// Anything else, such as a tool change or a comment, ends a run, and
+// lines outside runs are copied unchanged.  `rapid` is in mm/min.
+void optimizeDrilling(std::istream& in, std::ostream& out, double rapid, DrillStats& stats);
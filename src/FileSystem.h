@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FileInfo {
+    std::string name;
+    int64_t     size;
+    int64_t     mtime;  // seconds since the Unix epoch
+    bool        isDir;
+};
+
+// Platform file system helpers, implemented in windows/ and mac/
+
+// Returns -1 if the file does not exist
+int64_t fileSize(const char* path);
+
+// Lists the entries of a directory, excluding . and ..
+bool listDirectory(const std::string& dir, std::vector<FileInfo>& entries);
+
+// Creates a directory and any missing parents
+bool makeDirectories(const std::string& path);
+
+bool removeFile(const std::string& path);
+
+// Sets the modification time to now
+bool touchFile(const std::string& path);
+
+// Per-user directory for FluidTerm's caches
+std::string cacheDirectory();
+
+// A file mapped read-only into memory, so it can be sent without
+// copying.  ok() is false if the file cannot be opened or mapped.
+class MappedFile {
+private:
+    const char* m_data   = nullptr;
+    size_t      m_size   = 0;
+    bool        m_ok     = false;
+    void*       m_handle = nullptr;  // the mapping object on Windows
+
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool        ok() const { return m_ok; }
+    const char* data() const { return m_data; }
+    size_t      size() const { return m_size; }
+};
@@ -0,0 +1,223 @@
+#include "Fixture.h"
+#include "SendGCode.h"
+#include "HeightMap.h"
+#include "Pipeline.h"
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+static const double DEG_TO_RAD = 3.14159265358979323846 / 180.0;
+
+bool loadFixtures(const std::string& path, std::vector<PartPlacement>& parts, double& safeZ) {
+    std::ifstream infile(path);
+    if (infile.fail()) {
+        return false;
+    }
+    parts.clear();
+    for (std::string line; std::getline(infile, line);) {
+        auto pos = line.find('#');
+        if (pos != std::string::npos) {
+            line.erase(pos);
+        }
+        std::istringstream words(line);
+        std::string        first;
+        if (!(words >> first)) {
+            continue;
+        }
+        if (first == "safez") {
+            if (!(words >> safeZ)) {
+                return false;
+            }
+            continue;
+        }
+        PartPlacement part { 0, 0, 0 };
+        std::istringstream number(first);
+        if (!(number >> part.dx) || !(words >> part.dy)) {
+            return false;
+        }
+        // The angle is optional, but what is there must be a number
+        if (!(words >> part.angle)) {
+            if (!words.eof()) {
+                return false;
+            }
+        } else if (!(words >> std::ws).eof()) {
+            return false;
+        }
+        parts.push_back(part);
+    }
+    return !parts.empty();
+}
+
+void FixtureTransform::setPart(const PartPlacement& part) {
+    m_part  = part;
+    m_cos   = std::cos(part.angle * DEG_TO_RAD);
+    m_sin   = std::sin(part.angle * DEG_TO_RAD);
+    m_state = GCodeState();
+}
+
+void FixtureTransform::apply(const char* line, size_t len, std::string& out) {
+    while (len && (line[len - 1] == '\r' || line[len - 1] == '\n')) {
+        --len;
+    }
+    bool parsed = parseGCode(line, len, m_block);
+    if (parsed) {
+        double from[3];
+        m_state.update(m_block, from);
+    }
+    bool xy = m_block.has('X') || m_block.has('Y');
+    bool ij = m_block.has('I') || m_block.has('J');
+    if (!parsed || !(xy || ij) || m_block.hasG(53) || !m_state.isMotion(m_block)) {
+        out.append(line, len);
+        out += '\n';
+        return;
+    }
+
+    for (int w = 0; w < m_block.nwords; ++w) {
+        char letter = m_block.words[w].letter;
+        if (letter != 'X' && letter != 'Y' && letter != 'I' && letter != 'J') {
+            appendWord(out, letter, m_block.words[w].value);
+        }
+    }
+    if (xy) {
+        double x, y, ox = 0, oy = 0;
+        if (m_state.absolute) {
+            // Both coordinates of the target are needed to rotate it
+            x  = m_state.pos[0];
+            y  = m_state.pos[1];
+            ox = m_part.dx;
+            oy = m_part.dy;
+        } else {
+            x = m_block.value('X', 0);
+            y = m_block.value('Y', 0);
+        }
+        appendWord(out, 'X', x * m_cos - y * m_sin + ox);
+        appendWord(out, 'Y', x * m_sin + y * m_cos + oy);
+    }
+    if (ij) {
+        // Arc centers are always relative, so they only rotate
+        double i = m_block.value('I', 0);
+        double j = m_block.value('J', 0);
+        appendWord(out, 'I', i * m_cos - j * m_sin);
+        appendWord(out, 'J', i * m_sin + j * m_cos);
+    }
+    out += '\n';
+}
+
+// Adds a line ahead of the first line of a pass.  It runs last, so the
+// line goes out exactly as written.
+class PrefixTransform : public GCodeTransform {
+private:
+    std::string m_prefix;
+
+public:
+    explicit PrefixTransform(const std::string& prefix) : m_prefix(prefix) {}
+
+    const char* name() const override { return "prefix"; }
+
+    void apply(const char* line, size_t len, std::string& out) override {
+        out += m_prefix;
+        m_prefix.clear();
+        out.append(line, len);
+        out += '\n';
+    }
+};
+
+// Runs the passes, handing each one's stream and chain to `sendPass`
+static int runFixtureJob(std::istream&                                             infile,
+                         const std::vector<PartPlacement>&                         parts,
+                         double                                                    safeZ,
+                         GCodeTransform*                                           after,
+                         std::ostream&                                             log,
+                         const std::function<int(std::istream&, GCodeTransform&)>& sendPass) {
+    FixtureTransform placement;
+    for (size_t n = 0; n < parts.size(); ++n) {
+        const PartPlacement& part = parts[n];
+        log << "Part " << n + 1 << "/" << parts.size() << " at X" << part.dx << " Y" << part.dy;
+        if (part.angle) {
+            log << " rotated " << part.angle;
+        }
+        log << std::endl;
+
+        std::string safeMove;
+        if (n) {
+            // Clear the previous part before the job's first move, at the
+            // height given rather than one leveled to the surface below
+            safeMove = "G90G0Z";
+            appendNumber(safeMove, safeZ);
+            safeMove += '\n';
+            if (after) {
+                after->bypassed(safeMove.data(), safeMove.length());
+            }
+        }
+        PrefixTransform prefix(safeMove);
+        placement.setPart(part);
+
+        TransformChain chain;
+        chain.add(&placement);
+        if (after) {
+            chain.add(after);
+        }
+        chain.add(&prefix);
+
+        infile.clear();
+        infile.seekg(0);
+        if (sendPass(infile, chain) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int sendFixtureJob(SerialPort&                       serial,
+                   std::istream&                     infile,
+                   const std::vector<PartPlacement>& parts,
+                   double                            safeZ,
+                   GCodeTransform*                   after,
+                   StarvationMonitor*                monitor) {
+    return runFixtureJob(infile, parts, safeZ, after, std::cout, [&](std::istream& in, GCodeTransform& chain) {
+        return sendGCode(serial, in, &chain, monitor);
+    });
+}
+
+bool testFixtureJob(std::ostream& out) {
+    // A job that ends in G1, so a part's first feed move needs its G1
+    // again after the rapid to the safe height
+    const char*                job   = "G1 Z-1 F100\nX10\nY10\n";
+    std::vector<PartPlacement> parts = { { 0, 0, 0 }, { 50, 0, 0 }, { 0, 50, 90 } };
+    HeightMap                  flat;
+    flat.setGrid(-100, -100, 50, 50, 5, 5);
+
+    bool ok = true;
+    for (bool level : { false, true }) {
+        LevelingTransform leveling(flat);
+        ModalTracker      modal(true);
+        Encoder           encoder(true);
+        TransformChain    compact;
+        if (level) {
+            compact.add(&leveling);
+        }
+        compact.add(&modal);
+        compact.add(&encoder);
+
+        std::istringstream infile(job);
+        std::ostringstream log;
+        size_t             n = 0;
+        runFixtureJob(infile, parts, 5, &compact, log, [&](std::istream& in, GCodeTransform& chain) {
+            // The pass's first line after the safe move must be a feed
+            std::string sent;
+            for (std::string line; std::getline(in, line);) {
+                chain.apply(line.data(), line.length(), sent);
+            }
+            std::istringstream lines(sent);
+            std::string        first;
+            while (std::getline(lines, first) && !first.compare(0, 6, "G90G0Z")) {}
+            bool feed = first.find("G1") != std::string::npos;
+            out << (level ? "Compact and leveled" : "Compact") << ", part " << ++n << ": ";
+            out << (feed ? "ok" : "first move \"" + first + "\" has no G1") << std::endl;
+            ok = ok && feed;
+            return 0;
+        });
+    }
+    return ok;
+}
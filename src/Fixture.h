@@ -0,0 +1,57 @@
+#pragma once
+
+#include "SerialPort.h"
+#include "GCode.h"
+#include "Starvation.h"
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Where one copy of a job goes on the fixture plate.  The job is
+// rotated about its own origin by `angle` degrees, then offset.
+struct PartPlacement {
+    double dx, dy;
+    double angle;
+};
+
+// A fixture file lists one part per line as "dx dy [angle]".  A line
+// "safez Z" sets the height for the move between parts; '#' starts a
+// comment.
+bool loadFixtures(const std::string& path, std::vector<PartPlacement>& parts, double& safeZ);
+
+// Moves the job to one part's placement on the fly.  Positions in G53
+// machine coordinates are left alone.
+class FixtureTransform : public GCodeTransform {
+private:
+    PartPlacement m_part;
+    double        m_cos, m_sin;
+    GCodeState    m_state;
+    GCodeBlock    m_block;
+
+public:
+    FixtureTransform() { setPart({ 0, 0, 0 }); }
+
+    // Selects the placement and resets the modal state for the next pass
+    void setPart(const PartPlacement& part);
+
+    const char* name() const override { return "fixture"; }
+    void        apply(const char* line, size_t len, std::string& out) override;
+};
+
+// Streams the job once per part, rewinding the same stream for each pass
+// instead of holding copies.  `after` runs on the placed output, e.g.
+// for height map leveling; the move to the safe height between parts
+// goes out as written.  Returns negative if any pass fails.
+int sendFixtureJob(SerialPort&                       serial,
+                   std::istream&                     infile,
+                   const std::vector<PartPlacement>& parts,
+                   double                            safeZ,
+                   GCodeTransform*                   after,
+                   StarvationMonitor*                monitor = nullptr);
+
+// Runs a job for several parts through --compact's stages, with and
+// without leveling, and checks that each part's first feed move keeps
+// its G1 after the rapid to the safe height.  Prints a line per part;
+// false if any fails.
+bool testFixtureJob(std::ostream& out);
@@ -0,0 +1,216 @@
+#include "GCode.h"
+#include <cstdio>
+
+const GCodeWord* GCodeBlock::find(char letter) const {
+    for (int i = 0; i < nwords; ++i) {
+        if (words[i].letter == letter) {
+            return &words[i];
+        }
+    }
+    return nullptr;
+}
+
+double GCodeBlock::value(char letter, double dflt) const {
+    auto w = find(letter);
+    return w ? w->value : dflt;
+}
+
+bool GCodeBlock::hasG(int code) const {
+    for (int i = 0; i < nwords; ++i) {
+        if (words[i].letter == 'G' && words[i].value == code) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseNumber(const char*& p, const char* end, double& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p++ == '-';
+    }
+    double whole  = 0;
+    double scale  = 1;
+    bool   digits = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        whole  = whole * 10 + (*p - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            scale /= 10;
+            whole += (*p - '0') * scale;
+            digits = true;
+        }
+    }
+    value = negative ? -whole : whole;
+    return digits;
+}
+
+bool parseGCode(const char* line, size_t len, GCodeBlock& block) {
+    block.nwords    = 0;
+    const char* p   = line;
+    const char* end = line + len;
+    while (p < end) {
+        char c = *p;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            ++p;
+            continue;
+        }
+        if (c == ';') {
+            break;
+        }
+        if (c == '(') {
+            while (p < end && *p != ')') {
+                ++p;
+            }
+            if (p < end) {
+                ++p;
+            }
+            continue;
+        }
+        if (c >= 'a' && c <= 'z') {
+            c -= 'a' - 'A';
+        }
+        if (c < 'A' || c > 'Z') {
+            return false;
+        }
+        ++p;
+        double value;
+        if (!parseNumber(p, end, value)) {
+            return false;
+        }
+        if (c == 'N') {
+            continue;
+        }
+        if (block.nwords == MAX_GCODE_WORDS) {
+            return false;
+        }
+        block.words[block.nwords++] = { c, value };
+    }
+    return true;
+}
+
+void appendNumber(std::string& out, double value, int decimals) {
+    char buf[40];
+    int  n = snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    if (n <= 0 || n >= int(sizeof(buf))) {
+        return;
+    }
+    if (decimals > 0) {
+        while (buf[n - 1] == '0') {
+            --n;
+        }
+        if (buf[n - 1] == '.') {
+            --n;
+        }
+    }
+    if (n == 2 && buf[0] == '-' && buf[1] == '0') {
+        out += '0';
+        return;
+    }
+    out.append(buf, n);
+}
+
+void appendWord(std::string& out, char letter, double value) {
+    out += letter;
+    appendNumber(out, value);
+}
+
+// Blocks with these G codes use axis words for something other than
+// motion in the work coordinate system, so they do not move our idea
+// of the current position.
+static bool nonModalAxisUse(const GCodeBlock& block) {
+    return block.hasG(4) || block.hasG(10) || block.hasG(28) || block.hasG(30) || block.hasG(53) || block.hasG(92);
+}
+
+bool GCodeState::isMotion(const GCodeBlock& block) const {
+    if (!(block.has('X') || block.has('Y') || block.has('Z'))) {
+        return false;
+    }
+    return !nonModalAxisUse(block);
+}
+
+void GCodeState::update(const GCodeBlock& block, double (&from)[3]) {
+    for (int i = 0; i < 3; ++i) {
+        from[i] = pos[i];
+    }
+    for (int i = 0; i < block.nwords; ++i) {
+        const GCodeWord& w = block.words[i];
+        if (w.letter == 'G') {
+            int code = int(w.value);
+            if (code != w.value) {
+                continue;  // G38.2, G91.1 etc.
+            }
+            if (code <= 3 || (code >= 80 && code <= 89)) {
+                motion = code;
+            }
+            if (code == 90) {
+                absolute = true;
+            } else if (code == 91) {
+                absolute = false;
+            } else if (code == 20) {
+                inches = true;
+            } else if (code == 21) {
+                inches = false;
+            }
+        } else if (w.letter == 'F') {
+            feed = w.value;
+        }
+    }
+    if (!isMotion(block)) {
+        return;
+    }
+    static const char axes[3] = { 'X', 'Y', 'Z' };
+    for (int i = 0; i < 3; ++i) {
+        // Canned cycles retract to the initial Z (G98) so only XY moves
+        if (motion >= 80 && i == 2) {
+            break;
+        }
+        auto w = block.find(axes[i]);
+        if (w) {
+            pos[i] = absolute ? w->value : pos[i] + w->value;
+        }
+    }
+}
+
+void TransformChain::add(GCodeTransform* stage) {
+    m_stages.push_back(stage);
+    if (m_stages.size() > 1) {
+        m_buffers.emplace_back();
+        m_buffers.back().reserve(65536);
+    }
+}
+
+void TransformChain::bypassed(const char* line, size_t len) {
+    for (GCodeTransform* stage : m_stages) {
+        stage->bypassed(line, len);
+    }
+}
+
+void TransformChain::apply(const char* line, size_t len, std::string& out) {
+    if (m_stages.empty()) {
+        out.append(line, len);
+        out += '\n';
+        return;
+    }
+    // Stage i writes to m_buffers[i] and the last stage writes to out
+    for (size_t i = 0; i < m_stages.size(); ++i) {
+        std::string& dest = i + 1 == m_stages.size() ? out : m_buffers[i];
+        if (i + 1 < m_stages.size()) {
+            dest.clear();
+        }
+        if (i == 0) {
+            m_stages[0]->apply(line, len, dest);
+            continue;
+        }
+        const std::string& src   = m_buffers[i - 1];
+        size_t             start = 0;
+        size_t             end;
+        while ((end = src.find('\n', start)) != std::string::npos) {
+            m_stages[i]->apply(src.c_str() + start, end - start, dest);
+            start = end + 1;
+        }
+    }
+}
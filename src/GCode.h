@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A single G-code word, e.g. X12.5 or G1
+struct GCodeWord {
+    char   letter;
+    double value;
+};
+
+const int MAX_GCODE_WORDS = 32;
+
+// One block (line) of G-code split into words.  Comments,
+// whitespace and line numbers are dropped by the parser.
+struct GCodeBlock {
+    GCodeWord words[MAX_GCODE_WORDS];
+    int       nwords;
+
+    const GCodeWord* find(char letter) const;
+    bool             has(char letter) const { return find(letter) != nullptr; }
+    double           value(char letter, double dflt) const;
+    bool             hasG(int code) const;
+};
+
+// Splits a line into words.  Returns false if the line is not
+// plain G-code (FluidNC $ commands, malformed words, too many words),
+// in which case the caller should pass the line through untouched.
+bool parseGCode(const char* line, size_t len, GCodeBlock& block);
+
+// Appends a number with up to `decimals` places, trailing zeros trimmed
+void appendNumber(std::string& out, double value, int decimals = 4);
+
+// Appends "X12.5" style word text
+void appendWord(std::string& out, char letter, double value);
+
+// The modal state needed to know where a block moves the machine.
+// Positions are in program units in the current work coordinate system.
+struct GCodeState {
+    int    motion   = 0;  // 0-3 for G0-G3, 80-89 for canned cycles
+    bool   absolute = true;
+    bool   inches   = false;
+    double pos[3]   = { 0, 0, 0 };
+    double feed     = 0;
+
+    // True if the block commands motion along X, Y or Z
+    bool isMotion(const GCodeBlock& block) const;
+
+    // Applies the block, leaving the old position in `from`
+    void update(const GCodeBlock& block, double (&from)[3]);
+
+    double toMm(double v) const { return inches ? v * 25.4 : v; }
+    double fromMm(double v) const { return inches ? v / 25.4 : v; }
+};
+
+// A streaming rewrite of G-code between the file and the serial port.
+// apply() appends the replacement for one input line to `out`, each
+// output line terminated by '\n'.  An input line can expand to any
+// number of output lines, including none.  `out` is reused by the
+// caller so steady-state streaming does not allocate.
+class GCodeTransform {
+public:
+    virtual ~GCodeTransform() {}
+    virtual const char* name() const { return "transform"; }
+    virtual void        apply(const char* line, size_t len, std::string& out) = 0;
+
+    // Notes a line that reaches the machine without passing through
+    // apply(), so the lines after it are rewritten from where it leaves
+    // the machine.  Only called while nothing is streaming.
+    virtual void bypassed(const char*, size_t) {}
+};
+
+// Runs transforms in order, each one's output feeding the next
+class TransformChain : public GCodeTransform {
+private:
+    std::vector<GCodeTransform*> m_stages;
+    std::vector<std::string>     m_buffers;
+
+public:
+    void add(GCodeTransform* stage);
+    bool empty() const { return m_stages.empty(); }
+
+    const std::vector<GCodeTransform*>& stages() const { return m_stages; }
+
+    void apply(const char* line, size_t len, std::string& out) override;
+    void bypassed(const char* line, size_t len) override;
+};
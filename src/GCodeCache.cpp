@@ -0,0 +1,176 @@
+#include "GCodeCache.h"
+#include "FileSystem.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+// Bump when the meaning of cached data changes
+static const char* CACHE_VERSION = "1";
+
+GCodeCache::GCodeCache(const std::string& dir, uint64_t limit) : m_dir(dir), m_limit(limit) {}
+
+static std::string keyName(uint64_t key) {
+    char name[20];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return name;
+}
+
+std::string GCodeCache::path(uint64_t key, const char* ext) const {
+    return m_dir + "/" + keyName(key) + "." + ext;
+}
+
+uint64_t GCodeCache::key(std::istream& source, const std::string& settings) {
+    Hash64 seed;
+    seed.update(CACHE_VERSION, strlen(CACHE_VERSION));
+    seed.update(settings.c_str(), settings.length());
+    return hashStream(source, seed.digest());
+}
+
+bool GCodeCache::lookup(uint64_t key, std::string& outputPath, std::vector<uint64_t>& index, std::string& stats) {
+    // The stats file is written last, so its presence marks a complete entry
+    std::ifstream statsFile(path(key, "stats"));
+    if (statsFile.fail() || !std::getline(statsFile, stats)) {
+        return false;
+    }
+    std::ifstream indexFile(path(key, "idx"), std::ifstream::binary);
+    int64_t       indexSize = fileSize(path(key, "idx").c_str());
+    if (indexFile.fail() || indexSize < 0) {
+        return false;
+    }
+    index.resize(size_t(indexSize) / sizeof(uint64_t));
+    if (!indexFile.read(reinterpret_cast<char*>(index.data()), index.size() * sizeof(uint64_t))) {
+        return false;
+    }
+    outputPath = path(key, "gcode");
+    if (fileSize(outputPath.c_str()) < 0) {
+        return false;
+    }
+    touchFile(outputPath);
+    return true;
+}
+
+static bool writeFile(const std::string& path, const char* data, size_t len) {
+    std::string   tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ofstream::binary);
+    out.write(data, len);
+    out.close();
+    if (out.fail()) {
+        removeFile(tmp);
+        return false;
+    }
+    removeFile(path);
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool GCodeCache::create(uint64_t key, std::ofstream& out) {
+    if (!makeDirectories(m_dir)) {
+        return false;
+    }
+    out.open(path(key, "gcode.tmp"), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    return out.is_open();
+}
+
+bool GCodeCache::finish(uint64_t key, std::ofstream& out, const std::string& stats, std::string& outputPath) {
+    std::string tmp = path(key, "gcode.tmp");
+    out.close();
+    outputPath = path(key, "gcode");
+    removeFile(outputPath);
+    if (out.fail() || rename(tmp.c_str(), outputPath.c_str()) != 0) {
+        removeFile(tmp);
+        return false;
+    }
+
+    std::vector<uint64_t> index;
+    std::ifstream         in(outputPath, std::ifstream::binary);
+    std::vector<char>     buffer(1 << 16);
+    bool                  lineStart = true;
+    for (uint64_t pos = 0; in.read(buffer.data(), buffer.size()) || in.gcount();) {
+        size_t n = size_t(in.gcount());
+        for (size_t i = 0; i < n; ++i) {
+            if (lineStart) {
+                index.push_back(pos + i);
+            }
+            lineStart = buffer[i] == '\n';
+        }
+        pos += n;
+    }
+    std::string statsLine = stats + '\n';
+    bool        ok        = writeFile(path(key, "idx"), reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint64_t)) &&
+                writeFile(path(key, "stats"), statsLine.data(), statsLine.length());
+    evict(key);
+    return ok;
+}
+
+// A cache entry's files are its key in hex with one of these extensions.
+// Anything else in the directory belongs to something else.
+static bool entryStem(const FileInfo& f, std::string& stem) {
+    const size_t digits = 16;
+    if (f.isDir || f.name.length() <= digits + 1 || f.name[digits] != '.') {
+        return false;
+    }
+    for (size_t i = 0; i < digits; ++i) {
+        if (!isxdigit((unsigned char)f.name[i])) {
+            return false;
+        }
+    }
+    std::string ext = f.name.substr(digits + 1);
+    for (const char* known : { "gcode", "idx", "stats", "gcode.tmp", "idx.tmp", "stats.tmp" }) {
+        if (ext == known) {
+            stem = f.name.substr(0, digits);
+            return true;
+        }
+    }
+    return false;
+}
+
+void GCodeCache::evict(uint64_t keep) {
+    std::vector<FileInfo> files;
+    if (!listDirectory(m_dir, files)) {
+        return;
+    }
+    struct Entry {
+        uint64_t                 size  = 0;
+        int64_t                  mtime = 0;  // of the output; 0 for leftovers of a failed store
+        std::vector<std::string> names;
+    };
+    std::map<std::string, Entry> entries;
+    uint64_t                     total = 0;
+    for (auto& f : files) {
+        std::string stem;
+        if (!entryStem(f, stem)) {
+            continue;
+        }
+        Entry& e = entries[stem];
+        e.size += f.size;
+        e.names.push_back(f.name);
+        total += f.size;
+        if (f.name.compare(stem.length(), std::string::npos, ".gcode") == 0) {
+            e.mtime = f.mtime;
+        }
+    }
+    if (total <= m_limit) {
+        return;
+    }
+    // The entry just stored stays even if it ties on age with older ones
+    std::string                                  keepName = keyName(keep);
+    std::vector<std::pair<int64_t, std::string>> byAge;
+    for (auto& e : entries) {
+        if (e.first != keepName) {
+            byAge.emplace_back(e.second.mtime, e.first);
+        }
+    }
+    std::sort(byAge.begin(), byAge.end());
+    for (auto& old : byAge) {
+        if (total <= m_limit) {
+            break;
+        }
+        Entry& e = entries[old.second];
+        for (auto& name : e.names) {
+            removeFile(m_dir + "/" + name);
+        }
+        total -= e.size;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+// A local cache of pre-processed G-code, keyed by a hash of the source
+// contents and the processing settings.  Each entry holds the processed
+// output, the byte offset of every output line and a line of
+// statistics.  Least recently used entries are evicted to keep the
+// cache within its size limit.
+class GCodeCache {
+private:
+    std::string m_dir;
+    uint64_t    m_limit;
+
+    std::string path(uint64_t key, const char* ext) const;
+    void        evict(uint64_t keep);
+
+public:
+    GCodeCache(const std::string& dir, uint64_t limit);
+
+    // Hashes the rest of the source and rewinds it
+    static uint64_t key(std::istream& source, const std::string& settings);
+
+    // On a hit, returns the path of the processed output
+    bool lookup(uint64_t key, std::string& outputPath, std::vector<uint64_t>& index, std::string& stats);
+    // Opens `out` on a new entry's output, so it can be written as it is
+    // made.  finish() then indexes it and marks the entry complete, or
+    // removes it if writing failed.
+    bool create(uint64_t key, std::ofstream& out);
+    bool finish(uint64_t key, std::ofstream& out, const std::string& stats, std::string& outputPath);
+};
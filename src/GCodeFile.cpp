@@ -0,0 +1,118 @@
+#include "GCodeFile.h"
+#include <algorithm>
+#include <stdexcept>
+
+GzipBuffer::GzipBuffer(const std::string& path) :
+    m_file(path, std::ifstream::in | std::ifstream::binary), m_inflater(m_file), m_ring(RING_SIZE) {
+    start(0);
+}
+
+GzipBuffer::~GzipBuffer() {
+    stop();
+}
+
+void GzipBuffer::start(uint64_t pos) {
+    m_written = pos;
+    m_read    = pos;
+    m_end     = false;
+    m_error   = false;
+    m_stop    = false;
+    setg(nullptr, nullptr, nullptr);
+    m_worker = std::thread(&GzipBuffer::decompress, this);
+}
+
+void GzipBuffer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    m_worker.join();
+}
+
+void GzipBuffer::decompress() {
+    const size_t                 CHUNK = 256 << 10;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_changed.wait(lock, [&]() { return m_stop || m_written - m_read < m_ring.size(); });
+        if (m_stop) {
+            return;
+        }
+        size_t at   = size_t(m_written % m_ring.size());
+        size_t free = m_ring.size() - size_t(m_written - m_read);
+        size_t n    = std::min(std::min(free, m_ring.size() - at), CHUNK);
+        lock.unlock();
+        // The reader never looks past m_written, so this part of the ring is ours
+        long got = m_inflater.read(&m_ring[at], n);
+        lock.lock();
+        if (got > 0) {
+            m_written += got;
+        } else {
+            m_end   = true;
+            m_error = got < 0;
+        }
+        m_changed.notify_all();
+        if (m_end) {
+            return;
+        }
+    }
+}
+
+GzipBuffer::int_type GzipBuffer::underflow() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_read += egptr() - eback();
+    setg(nullptr, nullptr, nullptr);
+    m_changed.notify_all();
+    m_changed.wait(lock, [&]() { return m_end || m_written > m_read; });
+    if (m_written == m_read) {
+        if (m_error) {
+            throw std::runtime_error("corrupt gzip data");
+        }
+        return traits_type::eof();
+    }
+    size_t at = size_t(m_read % m_ring.size());
+    size_t n  = std::min(size_t(m_written - m_read), m_ring.size() - at);
+    char*  p  = &m_ring[at];
+    setg(p, p, p + n);
+    return traits_type::to_int_type(*p);
+}
+
+GzipBuffer::pos_type GzipBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    if (dir == std::ios_base::beg) {
+        return seekpos(off, which);
+    }
+    if (dir != std::ios_base::cur) {
+        return pos_type(off_type(-1));
+    }
+    uint64_t here = m_read + (gptr() - eback());
+    return off ? seekpos(here + off, which) : pos_type(here);
+}
+
+GzipBuffer::pos_type GzipBuffer::seekpos(pos_type pos, std::ios_base::openmode) {
+    uint64_t p = uint64_t(off_type(pos));
+    if (p >= m_read && p < m_read + (egptr() - eback())) {
+        // Still in the part of the ring being read
+        setg(eback(), eback() + (p - m_read), egptr());
+        return pos;
+    }
+    stop();
+    bool ok = m_inflater.seek(p);
+    start(p);
+    if (!ok) {
+        return pos_type(off_type(-1));
+    }
+    return pos;
+}
+
+GCodeFile::GCodeFile(const std::string& path) : std::istream(nullptr), m_file(path, std::ifstream::in | std::ifstream::binary) {
+    if (m_file.is_open() && Inflater::isGzip(m_file)) {
+        m_file.close();
+        m_gzip.reset(new GzipBuffer(path));
+        rdbuf(m_gzip.get());
+        return;
+    }
+    rdbuf(m_file.rdbuf());
+    if (!m_file.is_open()) {
+        setstate(std::ios_base::failbit);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Inflate.h"
+#include <condition_variable>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Decompresses a gzip file on a background thread into a ring buffer,
+// so memory stays bounded however large the file is.  Seeking restarts
+// the decompressor from its nearest access point.  Corrupt data makes
+// the reading stream go bad.
+class GzipBuffer : public std::streambuf {
+private:
+    std::ifstream           m_file;
+    Inflater                m_inflater;
+    std::vector<char>       m_ring;
+    uint64_t                m_written;   // output offset produced into the ring
+    uint64_t                m_read;      // output offset released by the reader
+    bool                    m_end;
+    bool                    m_error;
+    bool                    m_stop;
+    std::mutex              m_mutex;
+    std::condition_variable m_changed;
+    std::thread             m_worker;
+
+    void decompress();
+    void start(uint64_t pos);
+    void stop();
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+public:
+    static const size_t RING_SIZE = 4 << 20;
+
+    explicit GzipBuffer(const std::string& path);
+    ~GzipBuffer();
+};
+
+// Opens G-code for reading, decompressing it on the fly if the file is
+// gzipped.  Use it wherever a job file is read.
+class GCodeFile : public std::istream {
+private:
+    std::ifstream               m_file;
+    std::unique_ptr<GzipBuffer> m_gzip;
+
+public:
+    explicit GCodeFile(const std::string& path);
+
+    bool compressed() const { return m_gzip != nullptr; }
+};
@@ -0,0 +1,125 @@
+#include "Hash.h"
+#include <cstring>
+#include <vector>
+
+static const uint64_t P1 = 11400714785074694791ULL;
+static const uint64_t P2 = 14029467366897019727ULL;
+static const uint64_t P3 = 1609587929392839161ULL;
+static const uint64_t P4 = 9650029242287828579ULL;
+static const uint64_t P5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little-endian loads
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t xxRound(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= xxRound(0, val);
+    return acc * P1 + P4;
+}
+
+Hash64::Hash64(uint64_t seed) : m_seed(seed), m_total(0), m_buflen(0) {
+    m_v[0] = seed + P1 + P2;
+    m_v[1] = seed + P2;
+    m_v[2] = seed;
+    m_v[3] = seed - P1;
+}
+
+void Hash64::update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_total += len;
+
+    if (m_buflen + len < 32) {
+        memcpy(m_buf + m_buflen, p, len);
+        m_buflen += len;
+        return;
+    }
+    if (m_buflen) {
+        size_t fill = 32 - m_buflen;
+        memcpy(m_buf + m_buflen, p, fill);
+        for (int i = 0; i < 4; ++i) {
+            m_v[i] = xxRound(m_v[i], read64(m_buf + i * 8));
+        }
+        p += fill;
+        len -= fill;
+        m_buflen = 0;
+    }
+    // Four independent lanes keep the multiplier pipelines busy
+    uint64_t v0 = m_v[0], v1 = m_v[1], v2 = m_v[2], v3 = m_v[3];
+    for (; len >= 32; p += 32, len -= 32) {
+        v0 = xxRound(v0, read64(p));
+        v1 = xxRound(v1, read64(p + 8));
+        v2 = xxRound(v2, read64(p + 16));
+        v3 = xxRound(v3, read64(p + 24));
+    }
+    m_v[0] = v0;
+    m_v[1] = v1;
+    m_v[2] = v2;
+    m_v[3] = v3;
+    memcpy(m_buf, p, len);
+    m_buflen = len;
+}
+
+uint64_t Hash64::digest() const {
+    uint64_t h;
+    if (m_total >= 32) {
+        h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            h = mergeRound(h, m_v[i]);
+        }
+    } else {
+        h = m_seed + P5;
+    }
+    h += m_total;
+
+    const uint8_t* p   = m_buf;
+    const uint8_t* end = m_buf + m_buflen;
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxRound(0, read64(p));
+        h = rotl(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h ^= uint64_t(read32(p)) * P1;
+        h = rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * P5;
+        h = rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hashStream(std::istream& in, uint64_t seed) {
+    Hash64            hash(seed);
+    std::vector<char> buf(1 << 20);
+    while (in.read(buf.data(), buf.size()) || in.gcount()) {
+        hash.update(buf.data(), size_t(in.gcount()));
+    }
+    in.clear();
+    in.seekg(0);
+    return hash.digest();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+
+// Streaming XXH64, a fast non-cryptographic 64-bit hash, used to key
+// caches by file contents.
+class Hash64 {
+private:
+    uint64_t m_v[4];
+    uint64_t m_seed;
+    uint64_t m_total;
+    uint8_t  m_buf[32];
+    size_t   m_buflen;
+
+public:
+    explicit Hash64(uint64_t seed = 0);
+
+    void     update(const void* data, size_t len);
+    uint64_t digest() const;
+};
+
+// Hashes everything left in the stream, then rewinds it to the start
+uint64_t hashStream(std::istream& in, uint64_t seed = 0);
@@ -0,0 +1,245 @@
+#include "HeightMap.h"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+bool HeightMap::load(const std::string& path) {
+    std::ifstream infile(path);
+    if (infile.fail()) {
+        return false;
+    }
+    std::vector<double> values;
+    for (std::string line; std::getline(infile, line);) {
+        auto pos = line.find('#');
+        if (pos != std::string::npos) {
+            line.erase(pos);
+        }
+        std::istringstream words(line);
+        double             v;
+        while (words >> v) {
+            values.push_back(v);
+        }
+        if (!words.eof()) {
+            return false;
+        }
+    }
+    if (values.size() < 6) {
+        return false;
+    }
+    int nx = int(values[4]);
+    int ny = int(values[5]);
+    if (nx < 2 || ny < 2 || values[2] <= 0 || values[3] <= 0 || values.size() != 6 + size_t(nx) * ny) {
+        return false;
+    }
+    setGrid(values[0], values[1], values[2], values[3], nx, ny);
+    m_z.assign(values.begin() + 6, values.end());
+    return true;
+}
+
+bool HeightMap::save(const std::string& path) const {
+    std::ofstream outfile(path);
+    if (outfile.fail()) {
+        return false;
+    }
+    outfile << "# FluidTerm height map\n";
+    outfile << "# x0 y0 dx dy nx ny\n";
+    outfile << m_x0 << ' ' << m_y0 << ' ' << m_dx << ' ' << m_dy << ' ' << m_nx << ' ' << m_ny << '\n';
+    outfile << std::fixed;
+    outfile.precision(4);
+    for (int iy = 0; iy < m_ny; ++iy) {
+        for (int ix = 0; ix < m_nx; ++ix) {
+            outfile << (ix ? " " : "") << m_z[iy * m_nx + ix];
+        }
+        outfile << '\n';
+    }
+    return outfile.good();
+}
+
+void HeightMap::setGrid(double x0, double y0, double dx, double dy, int nx, int ny) {
+    m_x0 = x0;
+    m_y0 = y0;
+    m_dx = dx;
+    m_dy = dy;
+    m_nx = nx;
+    m_ny = ny;
+    m_z.assign(size_t(nx) * ny, 0.0);
+}
+
+// The loop body is branch-free so the compiler can vectorize it
+void HeightMap::interpolate(const double* __restrict x, const double* __restrict y, double* __restrict z, size_t n) const {
+    const double  rdx  = 1.0 / m_dx;
+    const double  rdy  = 1.0 / m_dy;
+    const double  maxx = m_nx - 1;
+    const double  maxy = m_ny - 1;
+    const int     nx   = m_nx;
+    const double* grid = m_z.data();
+
+    for (size_t i = 0; i < n; ++i) {
+        double fx = (x[i] - m_x0) * rdx;
+        double fy = (y[i] - m_y0) * rdy;
+        fx        = fx < 0 ? 0 : (fx > maxx ? maxx : fx);
+        fy        = fy < 0 ? 0 : (fy > maxy ? maxy : fy);
+
+        // Points on the far edge use the last cell with t == 1
+        int ix = int(fx);
+        int iy = int(fy);
+        ix     = ix > nx - 2 ? nx - 2 : ix;
+        iy     = iy > m_ny - 2 ? m_ny - 2 : iy;
+
+        double        tx  = fx - ix;
+        double        ty  = fy - iy;
+        const double* row = grid + iy * nx + ix;
+        double        z0  = row[0] + (row[1] - row[0]) * tx;
+        double        z1  = row[nx] + (row[nx + 1] - row[nx]) * tx;
+        z[i]              = z0 + (z1 - z0) * ty;
+    }
+}
+
+double HeightMap::at(double x, double y) const {
+    double z;
+    interpolate(&x, &y, &z, 1);
+    return z;
+}
+
+LevelingTransform::LevelingTransform(const HeightMap& map, double segment) : m_map(map), m_segment(segment) {
+    if (m_segment <= 0) {
+        m_segment = map.spacing() / 2;
+    }
+}
+
+static void passThrough(const char* line, size_t len, std::string& out) {
+    out.append(line, len);
+    out += '\n';
+}
+
+static bool isAxis(char letter) {
+    return letter == 'X' || letter == 'Y' || letter == 'Z';
+}
+
+void LevelingTransform::emitMove(const double (&from)[3], std::string& out) {
+    const double* to = m_state.pos;
+    double        dx = to[0] - from[0];
+    double        dy = to[1] - from[1];
+    double        dz = to[2] - from[2];
+    double        mm = std::hypot(m_state.toMm(dx), m_state.toMm(dy));
+    int           n  = int(std::ceil(mm / m_segment));
+    if (n < 1) {
+        n = 1;
+    }
+    bool xy = n > 1 || m_block.has('X') || m_block.has('Y');
+
+    for (int done = 0; done < n;) {
+        int count = n - done < CHUNK ? n - done : CHUNK;
+        for (int i = 0; i < count; ++i) {
+            double t = double(done + i + 1) / n;
+            m_x[i]   = m_state.toMm(from[0] + dx * t);
+            m_y[i]   = m_state.toMm(from[1] + dy * t);
+        }
+        m_map.interpolate(m_x, m_y, m_z, count);
+
+        for (int i = 0; i < count; ++i) {
+            double t = double(done + i + 1) / n;
+            if (done + i == 0) {
+                // The first segment carries the non-axis words of the original block
+                for (int w = 0; w < m_block.nwords; ++w) {
+                    const GCodeWord& word = m_block.words[w];
+                    if (!isAxis(word.letter)) {
+                        appendWord(out, word.letter, word.value);
+                    }
+                }
+            }
+            if (xy) {
+                appendWord(out, 'X', from[0] + dx * t);
+                appendWord(out, 'Y', from[1] + dy * t);
+            }
+            appendWord(out, 'Z', from[2] + dz * t + m_state.fromMm(m_z[i]));
+            out += '\n';
+        }
+        done += count;
+    }
+}
+
+// GCodeState skips G38.x, so probe mode is followed here: it lasts
+// until another motion mode is chosen
+static void trackProbing(const GCodeBlock& block, bool& probing) {
+    for (int i = 0; i < block.nwords; ++i) {
+        const GCodeWord& w = block.words[i];
+        if (w.letter != 'G') {
+            continue;
+        }
+        if (w.value > 38 && w.value < 39) {
+            probing = true;
+        } else if (w.value == 0 || w.value == 1 || w.value == 2 || w.value == 3 || (w.value >= 80 && w.value <= 89)) {
+            probing = false;
+        }
+    }
+}
+
+void LevelingTransform::trackKnownAxes() {
+    trackProbing(m_block, m_probing);
+    bool axisWords = m_block.has('X') || m_block.has('Y') || m_block.has('Z');
+    if (m_block.hasG(28) || m_block.hasG(30) || m_block.hasG(53) ||
+        (axisWords && (m_probing || m_block.hasG(10) || m_block.hasG(92)))) {
+        m_known[0] = m_known[1] = m_known[2] = false;
+        return;
+    }
+    if (!m_state.isMotion(m_block) || !m_state.absolute) {
+        return;
+    }
+    // A canned cycle's Z is the hole bottom, not where it ends
+    static const char axes[3] = { 'X', 'Y', 'Z' };
+    for (int i = 0; i < (m_state.motion >= 80 ? 2 : 3); ++i) {
+        if (m_block.has(axes[i])) {
+            m_known[i] = true;
+        }
+    }
+}
+
+void LevelingTransform::bypassed(const char* line, size_t len) {
+    while (len && (line[len - 1] == '\r' || line[len - 1] == '\n')) {
+        --len;
+    }
+    if (parseGCode(line, len, m_block)) {
+        double from[3];
+        m_state.update(m_block, from);
+        trackKnownAxes();
+    }
+}
+
+void LevelingTransform::apply(const char* line, size_t len, std::string& out) {
+    while (len && (line[len - 1] == '\r' || line[len - 1] == '\n')) {
+        --len;
+    }
+    if (!parseGCode(line, len, m_block)) {
+        passThrough(line, len, out);
+        return;
+    }
+
+    double from[3];
+    m_state.update(m_block, from);
+    bool known = m_known[0] && m_known[1] && m_known[2];
+    trackKnownAxes();
+    if (!m_state.isMotion(m_block)) {
+        passThrough(line, len, out);
+        return;
+    }
+    if (!known || m_probing || !m_state.absolute || m_state.motion >= 80) {
+        passThrough(line, len, out);
+        return;
+    }
+
+    if (m_state.motion == 2 || m_state.motion == 3) {
+        // Compensate the arc endpoint only
+        for (int w = 0; w < m_block.nwords; ++w) {
+            const GCodeWord& word = m_block.words[w];
+            if (word.letter != 'Z') {
+                appendWord(out, word.letter, word.value);
+            }
+        }
+        double offset = m_map.at(m_state.toMm(m_state.pos[0]), m_state.toMm(m_state.pos[1]));
+        appendWord(out, 'Z', m_state.pos[2] + m_state.fromMm(offset));
+        out += '\n';
+        return;
+    }
+    emitMove(from, out);
+}
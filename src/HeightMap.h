@@ -0,0 +1,69 @@
+#pragma once
+
+#include "GCode.h"
+#include <string>
+#include <vector>
+
+// A rectangular grid of probed Z heights, in mm.  The grid file is
+// plain text; '#' starts a comment.  The first line holds
+//   x0 y0 dx dy nx ny
+// followed by nx*ny Z values, one row of nx values per Y step,
+// starting at y0.
+class HeightMap {
+private:
+    double              m_x0, m_y0;
+    double              m_dx, m_dy;
+    int                 m_nx, m_ny;
+    std::vector<double> m_z;
+
+public:
+    HeightMap() : m_x0(0), m_y0(0), m_dx(1), m_dy(1), m_nx(0), m_ny(0) {}
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+    void setGrid(double x0, double y0, double dx, double dy, int nx, int ny);
+    void set(int ix, int iy, double z) { m_z[iy * m_nx + ix] = z; }
+
+    int    nx() const { return m_nx; }
+    int    ny() const { return m_ny; }
+    double spacing() const { return m_dx < m_dy ? m_dx : m_dy; }
+    bool   empty() const { return m_z.empty(); }
+
+    // Bilinear interpolation of n points at once.  Points outside the
+    // grid take the value at the nearest edge.
+    void interpolate(const double* x, const double* y, double* z, size_t n) const;
+    double at(double x, double y) const;
+};
+
+// Adds the height map offset to every linear move, splitting XY moves
+// longer than the segment length so the tool follows the surface
+// between probe points.  Arcs have their endpoint compensated but are
+// not split.  Moves made in G91 relative mode, canned cycles (G80-G89)
+// and G38.x probe moves are passed through uncompensated.  So are all
+// blocks until the program has set X, Y and Z, since before then the
+// start of a move is not known; probe moves, which stop wherever they
+// touch, G28, G30 and G53 moves and G10/G92 offset changes make the
+// position unknown again.
+class LevelingTransform : public GCodeTransform {
+private:
+    const HeightMap& m_map;
+    double           m_segment;  // mm
+    GCodeState       m_state;
+    GCodeBlock       m_block;
+    bool             m_known[3] = { false, false, false };  // axes the program has set
+    bool             m_probing  = false;                    // G38.x is the motion mode
+
+    // Per-chunk scratch for the interpolation kernel
+    static const int CHUNK = 64;
+    double           m_x[CHUNK], m_y[CHUNK], m_z[CHUNK];
+
+    void emitMove(const double (&from)[3], std::string& out);
+    void trackKnownAxes();
+
+public:
+    LevelingTransform(const HeightMap& map, double segment = 0);
+
+    const char* name() const override { return "leveling"; }
+    void        apply(const char* line, size_t len, std::string& out) override;
+    void        bypassed(const char* line, size_t len) override;
+};
@@ -0,0 +1,316 @@
+#include "HttpUpload.h"
+#include "RemoteFiles.h"
+#include "TcpSocket.h"
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+static const size_t   CHUNK      = 32 << 10;
+static const uint32_t CONNECT_MS = 1500;
+static const uint32_t REPLY_MS   = 30000;  // FluidNC answers once the file is closed
+static uint32_t       ioMs       = 10000;  // shortened by the self test
+static const char*    BOUNDARY   = "----FluidTermUploadBoundary7d4a1c";
+
+void splitHost(const std::string& address, std::string& host, uint16_t& port) {
+    auto colon = address.rfind(':');
+    if (colon != std::string::npos && address.find(':') == colon) {
+        host = address.substr(0, colon);
+        port = uint16_t(atoi(address.c_str() + colon + 1));
+    } else {
+        host = address;
+        port = 80;
+    }
+}
+
+// Reads the reply headers and returns the HTTP status, or -1
+static int readStatus(TcpSocket& socket) {
+    std::string reply;
+    char        buf[512];
+    while (reply.find("\r\n\r\n") == std::string::npos && reply.length() < 8192) {
+        int n = socket.recv(buf, sizeof(buf), REPLY_MS);
+        if (n <= 0) {
+            break;
+        }
+        reply.append(buf, size_t(n));
+    }
+    if (reply.compare(0, 5, "HTTP/") != 0) {
+        return -1;
+    }
+    auto space = reply.find(' ');
+    return space == std::string::npos ? -1 : atoi(reply.c_str() + space + 1);
+}
+
+int httpUpload(const std::string& host, uint16_t port, const std::string& remoteName, const char* data, size_t size,
+               XmodemStats* stats) {
+    std::string relative;
+    const char* device = remoteDevice(remoteName, relative);
+    std::string path   = "/" + relative;
+    std::string dir    = path.substr(0, path.rfind('/') + 1);
+
+    // The WebUI sends the directory, the size to check against, then
+    // the file named by its full path
+    std::string head;
+    head += std::string("--") + BOUNDARY + "\r\n";
+    head += "Content-Disposition: form-data; name=\"path\"\r\n\r\n" + dir + "\r\n";
+    head += std::string("--") + BOUNDARY + "\r\n";
+    head += "Content-Disposition: form-data; name=\"" + path + "S\"\r\n\r\n" + std::to_string(size) + "\r\n";
+    head += std::string("--") + BOUNDARY + "\r\n";
+    head += "Content-Disposition: form-data; name=\"myfile[]\"; filename=\"" + path + "\"\r\n";
+    head += "Content-Type: application/octet-stream\r\n\r\n";
+    std::string tail = std::string("\r\n--") + BOUNDARY + "--\r\n";
+
+    std::string request = std::string("POST ") + (device[0] == 'S' ? "/upload" : "/files") + " HTTP/1.1\r\n";
+    request += "Host: " + host + "\r\n";
+    request += std::string("Content-Type: multipart/form-data; boundary=") + BOUNDARY + "\r\n";
+    request += "Content-Length: " + std::to_string(head.length() + size + tail.length()) + "\r\n";
+    request += "Connection: close\r\n\r\n";
+    request += head;
+
+    TcpSocket socket;
+    if (!socket.connect(host, port, CONNECT_MS)) {
+        return -1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!socket.send(request.data(), request.length(), ioMs)) {
+        return -1;
+    }
+    for (size_t sent = 0; sent < size;) {
+        size_t n = size - sent < CHUNK ? size - sent : CHUNK;
+        if (!socket.send(data + sent, n, ioMs)) {
+            std::cout << std::endl << "HTTP upload stopped after " << sent << " bytes" << std::endl;
+            return -2;
+        }
+        sent += n;
+        std::cout << sent << " of " << size << " bytes (" << (sent * 100 / size) << "%)\r" << std::flush;
+    }
+    if (!socket.send(tail.data(), tail.length(), ioMs)) {
+        return -2;
+    }
+    int status = readStatus(socket);
+    if (size) {
+        std::cout << std::endl;
+    }
+    if (status < 200 || status >= 300) {
+        std::cout << "The web server refused " << remoteName << " (HTTP status " << status << ")" << std::endl;
+        return -2;
+    }
+    if (stats) {
+        stats->bytes   = size;
+        stats->wire    = request.length() + size + tail.length();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return int(size);
+}
+
+// The self test's stand-in for FluidNC's web server: how it treats the
+// one connection it takes
+struct StandIn {
+    int  status = 200;    // the reply, or 0 to hang up without one
+    bool stall  = false;  // take the connection but never read from it
+
+    std::string request;  // what arrived, headers and body
+    bool        complete = false;
+};
+
+// Reads a request with a Content-Length body
+static bool readRequest(TcpSocket& client, std::string& request) {
+    char   buf[16 << 10];
+    size_t length = std::string::npos;
+    while (length == std::string::npos || request.length() < length) {
+        int n = client.recv(buf, sizeof(buf), 5000);
+        if (n <= 0) {
+            return false;
+        }
+        request.append(buf, size_t(n));
+        auto end = request.find("\r\n\r\n");
+        if (length == std::string::npos && end != std::string::npos) {
+            auto field = request.find("\r\nContent-Length: ");
+            if (field == std::string::npos || field > end) {
+                return false;
+            }
+            length = end + 4 + strtoul(request.c_str() + field + 18, nullptr, 10);
+        }
+    }
+    return request.length() == length;
+}
+
+static void serve(TcpListener& listener, StandIn& standIn, std::future<void> done) {
+    TcpSocket client;
+    if (!listener.accept(client, 5000)) {
+        return;
+    }
+    if (standIn.stall) {
+        done.wait();
+        return;
+    }
+    standIn.complete = readRequest(client, standIn.request);
+    if (standIn.status) {
+        std::string reply = "HTTP/1.1 " + std::to_string(standIn.status) + (standIn.status < 300 ? " OK" : " Error") +
+                            "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        client.send(reply.data(), reply.length(), 1000);
+    }
+}
+
+// Discards the progress shown while the self test uploads
+class QuietBuffer : public std::streambuf {
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    int_type        overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+// Uploads `data` to a stand-in on a free loopback port.  With no
+// stand-in the port is closed again first, so the connection is refused.
+static int uploadTo(StandIn* standIn, const std::string& remoteName, const std::string& data) {
+    TcpListener listener;
+    uint16_t    port = 0;
+    if (!listener.listen(port)) {
+        return -100;
+    }
+    std::promise<void> done;
+    std::thread        server;
+    if (standIn) {
+        server = std::thread(serve, std::ref(listener), std::ref(*standIn), done.get_future());
+    } else {
+        listener.close();
+    }
+    QuietBuffer     discard;
+    std::streambuf* console = std::cout.rdbuf(&discard);
+    int             ret     = httpUpload("127.0.0.1", port, remoteName, data.data(), data.size());
+    std::cout.rdbuf(console);
+    done.set_value();
+    if (server.joinable()) {
+        server.join();
+    }
+    return ret;
+}
+
+// Splits a multipart body into each part's headers and contents.
+// Returns false unless the body is well formed and properly closed.
+static bool splitMultipart(const std::string& body, const std::string& boundary, std::vector<std::pair<std::string, std::string>>& parts) {
+    std::string delimiter = "--" + boundary;
+    if (body.compare(0, delimiter.length(), delimiter) != 0) {
+        return false;
+    }
+    for (size_t at = delimiter.length();;) {
+        if (body.compare(at, std::string::npos, "--\r\n") == 0) {
+            return true;
+        }
+        if (body.compare(at, 2, "\r\n") != 0) {
+            return false;
+        }
+        at += 2;
+        auto blank = body.find("\r\n\r\n", at);
+        if (blank == std::string::npos) {
+            return false;
+        }
+        auto next = body.find("\r\n" + delimiter, blank + 4);
+        if (next == std::string::npos) {
+            return false;
+        }
+        parts.push_back({ body.substr(at, blank - at), body.substr(blank + 4, next - blank - 4) });
+        at = next + 2 + delimiter.length();
+    }
+}
+
+// Checks an upload of `data` to `route` as the file `path`, in the
+// form FluidNC's WebUI uses.  Returns what is wrong, or an empty string.
+static std::string checkRequest(const StandIn& standIn, const std::string& route, const std::string& path, const std::string& data) {
+    const std::string& request = standIn.request;
+    if (!standIn.complete) {
+        return "the request was cut short";
+    }
+    if (request.compare(0, route.length() + 16, "POST " + route + " HTTP/1.1\r\n") != 0) {
+        return "it was not a POST to " + route;
+    }
+    auto        end   = request.find("\r\n\r\n");
+    std::string field = "\r\nContent-Type: multipart/form-data; boundary=";
+    auto        type  = request.find(field);
+    if (type == std::string::npos || type > end) {
+        return "it had no multipart boundary";
+    }
+    type += field.length();
+    std::string                                      boundary = request.substr(type, request.find("\r\n", type) - type);
+    std::vector<std::pair<std::string, std::string>> parts;
+    if (!splitMultipart(request.substr(end + 4), boundary, parts) || parts.size() != 3) {
+        return "the body was not three multipart parts";
+    }
+    std::string dir = path.substr(0, path.rfind('/') + 1);
+    if (parts[0].first.find("name=\"path\"") == std::string::npos || parts[0].second != dir) {
+        return "the directory part was not " + dir;
+    }
+    if (parts[1].first.find("name=\"" + path + "S\"") == std::string::npos || parts[1].second != std::to_string(data.size())) {
+        return "the size part was wrong";
+    }
+    if (parts[2].first.find("filename=\"" + path + "\"") == std::string::npos) {
+        return "the file part was not named " + path;
+    }
+    if (parts[2].second != data) {
+        return "the file arrived changed";
+    }
+    return "";
+}
+
+bool testHttpUpload(std::ostream& out) {
+    bool ok     = true;
+    auto report = [&](const char* what, const std::string& problem) {
+        out << what << ": " << (problem.empty() ? "ok" : problem) << std::endl;
+        ok = ok && problem.empty();
+    };
+    auto expect = [](int ret, int want) {
+        return ret == want ? std::string() : "returned " + std::to_string(ret) + ", not " + std::to_string(want);
+    };
+
+    // Every byte value, and lines that look like a boundary
+    std::string data;
+    for (int i = 0; data.length() < 200000; ++i) {
+        data += char(i * 7);
+        if (i % 1000 == 0) {
+            data += "\r\n--\r\n";
+        }
+    }
+
+    StandIn     sd;
+    int         ret     = uploadTo(&sd, "/sd/jobs/part.nc", data);
+    std::string problem = expect(ret, int(data.size()));
+    report("SD card file to /upload", problem.length() ? problem : checkRequest(sd, "/upload", "/jobs/part.nc", data));
+
+    StandIn local;
+    ret     = uploadTo(&local, "/localfs/config.yaml", data.substr(0, 1000));
+    problem = expect(ret, 1000);
+    report("Local file to /files", problem.length() ? problem : checkRequest(local, "/files", "/config.yaml", data.substr(0, 1000)));
+
+    StandIn empty;
+    ret     = uploadTo(&empty, "/sd/empty.nc", "");
+    problem = expect(ret, 0);
+    report("Empty file", problem.length() ? problem : checkRequest(empty, "/upload", "/empty.nc", ""));
+
+    // The failures that send the upload back to XModem: -1 for no
+    // server, -2 for one that does not take the file
+    report("Connection refused", expect(uploadTo(nullptr, "/sd/part.nc", data), -1));
+
+    StandIn refused;
+    refused.status = 500;
+    report("Status 500", expect(uploadTo(&refused, "/sd/part.nc", data), -2));
+
+    StandIn moved;
+    moved.status = 302;
+    report("Status 302", expect(uploadTo(&moved, "/sd/part.nc", data), -2));
+
+    StandIn hangUp;
+    hangUp.status = 0;
+    report("No reply", expect(uploadTo(&hangUp, "/sd/part.nc", data), -2));
+
+    // Enough to fill the socket buffers both ends, with a short wait
+    StandIn stalled;
+    stalled.stall = true;
+    uint32_t wait = ioMs;
+    ioMs          = 500;
+    ret           = uploadTo(&stalled, "/sd/big.nc", std::string(64 << 20, 'G'));
+    ioMs          = wait;
+    report("Stalled server", expect(ret, -2));
+    return ok;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Xmodem.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Sends a file to FluidNC's web server over Wi-Fi with a multipart POST,
+// the same request its WebUI makes: to /files for the local filesystem
+// or /upload for the SD card.  The body is written straight from `data`
+// in CHUNK pieces, with progress shown as it goes.  Returns the number
+// of bytes sent, -1 if the server cannot be reached, or -2 if it did not
+// accept the file.
+int httpUpload(const std::string& host, uint16_t port, const std::string& remoteName, const char* data, size_t size,
+               XmodemStats* stats = nullptr);
+
+// Splits "host[:port]", defaulting to port 80
+void splitHost(const std::string& address, std::string& host, uint16_t& port);
+
+// Uploads to stand-ins for the web server on the loopback interface:
+// checks the multipart body and the route for each filesystem, and that
+// a refused connection, an error status, a missing reply and a server
+// that stops reading each fail the way that sends the file by XModem.
+// Prints a line per case; false if any fails.
+bool testHttpUpload(std::ostream& out);
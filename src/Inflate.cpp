@@ -0,0 +1,493 @@
+#include "Inflate.h"
+#include "Crc.h"
+#include <cstring>
+
+static const uint16_t lengthBase[29]  = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                          31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t  lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30]    = { 1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                          193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t  distExtra[30]   = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+Inflater::Inflater(std::istream& in) : m_in(in), m_inbuf(1 << 16) {
+    reset();
+}
+
+bool Inflater::isGzip(std::istream& in) {
+    char magic[2] = { 0, 0 };
+    in.read(magic, 2);
+    in.clear();
+    in.seekg(0);
+    return uint8_t(magic[0]) == 0x1f && uint8_t(magic[1]) == 0x8b;
+}
+
+void Inflater::reset() {
+    m_in.clear();
+    m_in.seekg(0);
+    m_inLen     = 0;
+    m_inPos     = 0;
+    m_inBase    = 0;
+    m_bits      = 0;
+    m_nbits     = 0;
+    m_state     = HEADER;
+    m_last      = false;
+    m_copyLen   = 0;
+    m_wpos      = 0;
+    m_out       = 0;
+    m_memberOut = 0;
+    m_crc       = 0;
+}
+
+// Tops up the bit buffer to at least 57 bits, or as far as input lasts
+bool Inflater::fill() {
+    while (m_nbits <= 56) {
+        if (m_inPos == m_inLen) {
+            m_inBase += m_inLen;
+            m_in.read(reinterpret_cast<char*>(m_inbuf.data()), m_inbuf.size());
+            m_inLen = size_t(m_in.gcount());
+            m_inPos = 0;
+            if (m_inLen == 0) {
+                return false;
+            }
+        }
+        m_bits |= uint64_t(m_inbuf[m_inPos++]) << m_nbits;
+        m_nbits += 8;
+    }
+    return true;
+}
+
+bool Inflater::need(int n) {
+    if (m_nbits < n) {
+        fill();
+    }
+    return m_nbits >= n;
+}
+
+uint32_t Inflater::bits(int n) {
+    uint32_t v = uint32_t(m_bits & ((uint64_t(1) << n) - 1));
+    m_bits >>= n;
+    m_nbits -= n;
+    return v;
+}
+
+// Returns the next symbol, or -1 for an invalid code.  The caller has
+// made sure 15 bits are buffered.
+int Inflater::decode(const Huffman& h) {
+    uint16_t e = h.fast[m_bits & ((1 << Huffman::FAST_BITS) - 1)];
+    if (e) {
+        bits(e & 15);
+        return e >> 4;
+    }
+    // Canonical decode one bit at a time for long codes
+    int code  = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= 15; ++len) {
+        code |= int((m_bits >> (len - 1)) & 1);
+        int count = h.count[len];
+        if (code - count < first) {
+            bits(len);
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool Inflater::build(Huffman& h, const uint8_t* lengths, int n) {
+    memset(h.count, 0, sizeof(h.count));
+    memset(h.fast, 0, sizeof(h.fast));
+    for (int i = 0; i < n; ++i) {
+        h.count[lengths[i]]++;
+    }
+    h.count[0] = 0;
+
+    int      left = 1;
+    uint16_t offs[16];
+    offs[1] = 0;
+    for (int len = 1; len < 16; ++len) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) {
+            return false;  // over-subscribed
+        }
+        if (len < 15) {
+            offs[len + 1] = offs[len] + h.count[len];
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        if (lengths[i]) {
+            h.symbol[offs[lengths[i]]++] = uint16_t(i);
+        }
+    }
+
+    // Codes are stored most significant bit first, so the table is
+    // indexed by the reversed code
+    int code = 0;
+    int sym  = 0;
+    for (int len = 1; len <= Huffman::FAST_BITS; ++len) {
+        for (int k = 0; k < h.count[len]; ++k, ++code, ++sym) {
+            int rev = 0;
+            for (int b = 0; b < len; ++b) {
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            for (int fill = rev; fill < (1 << Huffman::FAST_BITS); fill += 1 << len) {
+                h.fast[fill] = uint16_t(h.symbol[sym] << 4 | len);
+            }
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+bool Inflater::fixedTables() {
+    uint8_t lengths[288];
+    int     i = 0;
+    for (; i < 144; ++i) {
+        lengths[i] = 8;
+    }
+    for (; i < 256; ++i) {
+        lengths[i] = 9;
+    }
+    for (; i < 280; ++i) {
+        lengths[i] = 7;
+    }
+    for (; i < 288; ++i) {
+        lengths[i] = 8;
+    }
+    build(m_lit, lengths, 288);
+    for (i = 0; i < 30; ++i) {
+        lengths[i] = 5;
+    }
+    return build(m_dist, lengths, 30);
+}
+
+bool Inflater::dynamicTables() {
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    if (!need(14)) {
+        return false;
+    }
+    int nlen  = bits(5) + 257;
+    int ndist = bits(5) + 1;
+    int ncode = bits(4) + 4;
+    if (nlen > 286 || ndist > 30) {
+        return false;
+    }
+    uint8_t lengths[320];
+    memset(lengths, 0, 19);
+    for (int i = 0; i < ncode; ++i) {
+        if (!need(3)) {
+            return false;
+        }
+        lengths[order[i]] = uint8_t(bits(3));
+    }
+    Huffman lencode;
+    if (!build(lencode, lengths, 19)) {
+        return false;
+    }
+
+    for (int i = 0; i < nlen + ndist;) {
+        need(15 + 7);
+        int sym = decode(lencode);
+        if (sym < 0 || m_nbits < 0) {
+            return false;
+        }
+        if (sym < 16) {
+            lengths[i++] = uint8_t(sym);
+            continue;
+        }
+        uint8_t len = 0;
+        int     rep;
+        if (sym == 16) {
+            if (i == 0) {
+                return false;
+            }
+            len = lengths[i - 1];
+            rep = 3 + bits(2);
+        } else if (sym == 17) {
+            rep = 3 + bits(3);
+        } else {
+            rep = 11 + bits(7);
+        }
+        if (i + rep > nlen + ndist) {
+            return false;
+        }
+        if (m_nbits < 0) {
+            return false;
+        }
+        while (rep--) {
+            lengths[i++] = len;
+        }
+    }
+    if (lengths[256] == 0) {
+        return false;  // no end-of-block code
+    }
+    return build(m_lit, lengths, nlen) && build(m_dist, lengths + nlen, ndist);
+}
+
+bool Inflater::header() {
+    uint8_t fixed[10];
+    for (uint8_t& b : fixed) {
+        if (!need(8)) {
+            return false;
+        }
+        b = uint8_t(bits(8));
+    }
+    if (fixed[0] != 0x1f || fixed[1] != 0x8b || fixed[2] != 8) {
+        return false;
+    }
+    int flags = fixed[3];
+    if (flags & 4) {
+        // FEXTRA
+        if (!need(16)) {
+            return false;
+        }
+        for (int xlen = bits(16); xlen; --xlen) {
+            if (!need(8)) {
+                return false;
+            }
+            bits(8);
+        }
+    }
+    for (int zeroTerminated = 8; zeroTerminated <= 16; zeroTerminated <<= 1) {
+        // FNAME, FCOMMENT
+        if (flags & zeroTerminated) {
+            do {
+                if (!need(8)) {
+                    return false;
+                }
+            } while (bits(8));
+        }
+    }
+    if (flags & 2) {
+        // FHCRC
+        if (!need(16)) {
+            return false;
+        }
+        bits(16);
+    }
+    m_memberOut = 0;
+    m_crc       = 0;
+    return true;
+}
+
+// Checks the member's CRC and length, then moves on to the next member
+// if one follows
+bool Inflater::trailer() {
+    bits(m_nbits & 7);
+    if (!need(64)) {
+        return false;
+    }
+    uint32_t crc  = bits(32);
+    uint32_t size = bits(32);
+    if (crc != m_crc || size != uint32_t(m_memberOut)) {
+        return false;
+    }
+    if (need(16) && (m_bits & 0xffff) == 0x8b1f) {
+        m_state = HEADER;
+    } else {
+        m_state = DONE;  // trailing garbage is ignored, as gzip does
+    }
+    return true;
+}
+
+long Inflater::read(char* out, size_t len) {
+    uint8_t* dest     = reinterpret_cast<uint8_t*>(out);
+    size_t   produced = 0;
+
+    auto put = [&](uint8_t b) {
+        dest[produced++] = b;
+        m_window[m_wpos] = b;
+        m_wpos           = (m_wpos + 1) & 32767;
+    };
+
+    while (produced < len && m_state != DONE) {
+        if (m_copyLen) {
+            size_t n = len - produced < m_copyLen ? len - produced : m_copyLen;
+            m_copyLen -= n;
+            while (n--) {
+                put(m_window[(m_wpos - m_copyDist) & 32767]);
+            }
+            continue;
+        }
+        switch (m_state) {
+            case HEADER:
+                if (!header()) {
+                    m_state = BAD;
+                    break;
+                }
+                m_state = BLOCK;
+                break;
+
+            case BLOCK: {
+                if (m_last) {
+                    m_last  = false;
+                    m_state = TRAILER;
+                    break;
+                }
+                uint64_t total = m_out + produced;
+                if (total >= (m_points.size() ? m_points.back().out : 0) + INTERVAL) {
+                    uint64_t bit = (m_inBase + m_inPos) * 8 - m_nbits;
+                    m_points.push_back({ total, bit, crc32(m_crc, dest, produced), m_memberOut + produced, m_wpos, {} });
+                    m_points.back().window.assign(m_window, m_window + sizeof(m_window));
+                }
+                if (!need(3)) {
+                    m_state = BAD;
+                    break;
+                }
+                m_last   = bits(1);
+                int type = bits(2);
+                if (type == 0) {
+                    bits(m_nbits & 7);
+                    if (!need(32)) {
+                        m_state = BAD;
+                        break;
+                    }
+                    uint32_t n  = bits(16);
+                    uint32_t nn = bits(16);
+                    if (n != (~nn & 0xffff)) {
+                        m_state = BAD;
+                        break;
+                    }
+                    m_stored = n;
+                    m_state  = STORED;
+                } else if (type == 1) {
+                    fixedTables();
+                    m_state = CODES;
+                } else if (type == 2 && dynamicTables()) {
+                    m_state = CODES;
+                } else {
+                    m_state = BAD;
+                }
+            } break;
+
+            case STORED:
+                while (m_stored && produced < len) {
+                    if (!need(8)) {
+                        m_state = BAD;
+                        break;
+                    }
+                    put(uint8_t(bits(8)));
+                    --m_stored;
+                }
+                if (m_state == STORED && m_stored == 0) {
+                    m_state = BLOCK;
+                }
+                break;
+
+            case CODES:
+                while (produced < len) {
+                    if (m_nbits < 48) {
+                        fill();
+                    }
+                    int sym = decode(m_lit);
+                    if (sym < 0 || m_nbits < 0) {
+                        m_state = BAD;
+                        break;
+                    }
+                    if (sym < 256) {
+                        put(uint8_t(sym));
+                        continue;
+                    }
+                    if (sym == 256) {
+                        m_state = BLOCK;
+                        break;
+                    }
+                    sym -= 257;
+                    if (sym >= 29) {
+                        m_state = BAD;
+                        break;
+                    }
+                    size_t length = lengthBase[sym] + bits(lengthExtra[sym]);
+                    int    dsym   = decode(m_dist);
+                    if (dsym < 0 || dsym >= 30) {
+                        m_state = BAD;
+                        break;
+                    }
+                    size_t dist = distBase[dsym] + bits(distExtra[dsym]);
+                    if (m_nbits < 0 || dist > m_memberOut + produced || dist > 32768) {
+                        m_state = BAD;
+                        break;
+                    }
+                    m_copyLen  = length;
+                    m_copyDist = dist;
+                    break;
+                }
+                break;
+
+            case TRAILER:
+                m_crc = crc32(m_crc, dest, produced);
+                m_memberOut += produced;
+                m_out += produced;
+                dest += produced;
+                len -= produced;
+                produced = 0;
+                if (!trailer()) {
+                    m_state = BAD;
+                }
+                break;
+
+            case DONE:
+            case BAD:
+                break;
+        }
+        if (m_state == BAD) {
+            return -1;
+        }
+    }
+    m_crc = crc32(m_crc, dest, produced);
+    m_memberOut += produced;
+    m_out += produced;
+    return long(dest + produced - reinterpret_cast<uint8_t*>(out));
+}
+
+bool Inflater::seek(uint64_t pos) {
+    if (pos == m_out) {
+        return true;
+    }
+    const AccessPoint* point = nullptr;
+    for (const AccessPoint& p : m_points) {
+        if (p.out <= pos) {
+            point = &p;
+        }
+    }
+    if (point && (pos < m_out || point->out > m_out)) {
+        m_in.clear();
+        m_in.seekg(point->bit / 8);
+        m_inBase    = point->bit / 8;
+        m_inLen     = 0;
+        m_inPos     = 0;
+        m_bits      = 0;
+        m_nbits     = 0;
+        m_state     = BLOCK;
+        m_last      = false;
+        m_copyLen   = 0;
+        m_out       = point->out;
+        m_memberOut = point->memberOut;
+        m_crc       = point->crc;
+        m_wpos      = point->wpos;
+        memcpy(m_window, point->window.data(), sizeof(m_window));
+        if (point->bit % 8) {
+            if (!need(8)) {
+                return false;
+            }
+            bits(point->bit % 8);
+        }
+    } else if (pos < m_out) {
+        reset();
+    }
+
+    char skip[4096];
+    while (m_out < pos) {
+        uint64_t want = pos - m_out;
+        long     n    = read(skip, want < sizeof(skip) ? size_t(want) : sizeof(skip));
+        if (n <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+// A streaming gzip (RFC 1952) decompressor over a seekable stream.
+// Concatenated members are decoded as one stream, and each member's
+// CRC-32 and length are checked.
+//
+// As it goes, it records access points at deflate block boundaries:
+// the compressed bit position plus the 32K window needed to resume
+// there.  seek() restarts from the nearest one, so random access into
+// a large compressed file only decodes up to INTERVAL bytes.
+class Inflater {
+public:
+    static const uint64_t INTERVAL = 16 << 20;  // output bytes between access points
+
+private:
+    struct Huffman {
+        static const int FAST_BITS = 10;
+
+        uint16_t fast[1 << FAST_BITS];  // symbol << 4 | length, 0 if longer
+        uint16_t count[16];
+        uint16_t symbol[288];
+    };
+
+    struct AccessPoint {
+        uint64_t             out;  // total output before the block
+        uint64_t             bit;  // compressed bit position of the block
+        uint32_t             crc;
+        uint64_t             memberOut;
+        size_t               wpos;
+        std::vector<uint8_t> window;
+    };
+
+    enum State { HEADER, BLOCK, STORED, CODES, TRAILER, DONE, BAD };
+
+    std::istream&        m_in;
+    std::vector<uint8_t> m_inbuf;
+    size_t               m_inLen;
+    size_t               m_inPos;
+    uint64_t             m_inBase;  // stream offset of m_inbuf[0]
+    uint64_t             m_bits;
+    int                  m_nbits;
+
+    State    m_state;
+    bool     m_last;       // the current block is the member's last
+    size_t   m_stored;     // bytes left in a stored block
+    size_t   m_copyLen;    // match bytes left to copy
+    size_t   m_copyDist;
+    Huffman  m_lit, m_dist;
+    uint8_t  m_window[32768];
+    size_t   m_wpos;
+    uint64_t m_out;        // total output
+    uint64_t m_memberOut;  // output of the current member
+    uint32_t m_crc;
+
+    std::vector<AccessPoint> m_points;
+
+    bool     fill();
+    bool     need(int n);
+    uint32_t bits(int n);
+    int      decode(const Huffman& h);
+    bool     build(Huffman& h, const uint8_t* lengths, int n);
+    bool     fixedTables();
+    bool     dynamicTables();
+    bool     header();
+    bool     trailer();
+    void     reset();
+
+public:
+    explicit Inflater(std::istream& in);
+
+    // Returns true if the stream starts with the gzip magic number
+    static bool isGzip(std::istream& in);
+
+    // Decompresses up to `len` bytes.  Returns the number produced,
+    // 0 at the end, or -1 if the data is corrupt or truncated.
+    long read(char* out, size_t len);
+
+    // Positions the output at `pos`.  Returns false past the end or on
+    // corrupt data.
+    bool seek(uint64_t pos);
+
+    uint64_t tell() const { return m_out; }
+};
@@ -0,0 +1,255 @@
+#include "JobQueue.h"
+#include "GCode.h"
+#include "LineReader.h"
+#include "StatusReport.h"
+#include "Console.h"
+#include "Colorize.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+JobSource::JobSource(const QueuedJob& job) :
+    m_head(job.head), m_file(job.path), m_buf(1 << 16), m_bufPos(0), m_inHead(true) {
+    char* head = const_cast<char*>(m_head.data());
+    setg(head, head, head + m_head.size());
+}
+
+JobSource::int_type JobSource::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (m_inHead) {
+        m_inHead = false;
+        m_bufPos = m_head.size();
+        m_file.clear();
+        m_file.seekg(m_bufPos);
+    } else {
+        m_bufPos += egptr() - eback();
+    }
+    m_file.read(m_buf.data(), m_buf.size());
+    size_t n = size_t(m_file.gcount());
+    if (m_file.bad()) {
+        throw std::runtime_error("read error");
+    }
+    setg(m_buf.data(), m_buf.data(), m_buf.data() + n);
+    return n ? traits_type::to_int_type(m_buf[0]) : traits_type::eof();
+}
+
+JobSource::pos_type JobSource::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    if (dir == std::ios_base::beg) {
+        return seekpos(off, which);
+    }
+    if (dir != std::ios_base::cur) {
+        return pos_type(off_type(-1));
+    }
+    uint64_t here = m_inHead ? gptr() - eback() : m_bufPos + (gptr() - eback());
+    return off ? seekpos(here + off, which) : pos_type(here);
+}
+
+JobSource::pos_type JobSource::seekpos(pos_type pos, std::ios_base::openmode) {
+    uint64_t p = uint64_t(off_type(pos));
+    if (p < m_head.size()) {
+        char* head = const_cast<char*>(m_head.data());
+        m_inHead   = true;
+        setg(head, head + p, head + m_head.size());
+        return pos;
+    }
+    m_inHead = false;
+    m_bufPos = p;
+    m_file.clear();
+    m_file.seekg(p);
+    setg(m_buf.data(), m_buf.data(), m_buf.data());
+    return pos;
+}
+
+// Reads the whole file once: line offsets, the head, and checks that
+// every line will be accepted by the controller
+static void prepareJob(QueuedJob& job, const std::atomic<bool>& stop) {
+    GCodeFile infile(job.path);
+    if (infile.fail()) {
+        job.error = "cannot open the file";
+        return;
+    }
+    GCodeBlock block;
+    uint64_t   offset = 0;
+    for (std::string line; std::getline(infile, line) && !stop;) {
+        job.index.push_back(offset);
+        size_t size = line.length() + 1;
+        if (job.head.length() < JobQueue::PREFETCH_BYTES) {
+            job.head.append(line);
+            job.head += '\n';
+        }
+        offset += size;
+        if (line.length() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.length() > JobQueue::MAX_LINE && job.error.empty()) {
+            job.error = "line " + std::to_string(job.index.size()) + " is longer than " + std::to_string(JobQueue::MAX_LINE) + " characters";
+        }
+        if (!parseGCode(line.c_str(), line.length(), block)) {
+            job.nonGCode++;
+        }
+    }
+    if (infile.bad()) {
+        job.error = "read error";
+        return;
+    }
+    if (job.index.empty()) {
+        job.error = "the file is empty";
+        return;
+    }
+    infile.clear();
+    infile.seekg(0, std::ios_base::end);
+    if (uint64_t(infile.tellg()) < offset && job.head.length() == offset) {
+        // The last line had no newline
+        job.head.pop_back();
+    }
+}
+
+JobQueue::~JobQueue() {
+    if (!m_worker.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    m_worker.join();
+}
+
+// Prepares the next job to run and the one after it, no further ahead
+void JobQueue::prefetch() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        QueuedJob* job = nullptr;
+        m_changed.wait(lock, [&]() {
+            for (size_t i = m_next; i < m_jobs.size() && i <= m_next + 1 && !job; ++i) {
+                if (!m_jobs[i]->prepared) {
+                    job = m_jobs[i].get();
+                }
+            }
+            return m_stop || job;
+        });
+        if (m_stop) {
+            return;
+        }
+        m_busy = true;
+        lock.unlock();
+        prepareJob(*job, m_stop);
+        lock.lock();
+        m_busy        = false;
+        job->prepared = true;
+        m_changed.notify_all();
+    }
+}
+
+void JobQueue::add(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.emplace_back(new QueuedJob);
+    m_jobs.back()->path = path;
+    if (!m_worker.joinable()) {
+        m_worker = std::thread(&JobQueue::prefetch, this);
+    }
+    m_changed.notify_all();
+}
+
+size_t JobQueue::pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size() - m_next;
+}
+
+QueuedJob* JobQueue::next() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_next == m_jobs.size()) {
+        return nullptr;
+    }
+    QueuedJob* job = m_jobs[m_next].get();
+    m_changed.wait(lock, [&]() { return job->prepared; });
+    ++m_next;
+    m_changed.notify_all();
+    return job;
+}
+
+void JobQueue::skipRest() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // Let a preparation in progress finish before its job can be dropped
+    m_changed.wait(lock, [&]() { return !m_busy; });
+    for (; m_next < m_jobs.size(); ++m_next) {
+        m_jobs[m_next]->state = QueuedJob::SKIPPED;
+    }
+}
+
+void JobQueue::report(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    static const char* states[] = { "pending", "done", "FAILED", "skipped" };
+    for (size_t i = 0; i < m_next; ++i) {
+        const QueuedJob& job = *m_jobs[i];
+        char             text[80];
+        snprintf(text, sizeof(text), "%2d %-8s %8lu lines %8.1f s  ", int(i + 1), states[job.state], (unsigned long)job.index.size(), job.seconds);
+        out << text << job.path;
+        if (job.error.length()) {
+            out << ": " << job.error;
+        } else if (job.nonGCode) {
+            out << " (" << job.nonGCode << " lines sent as-is)";
+        }
+        out << std::endl;
+    }
+    m_jobs.erase(m_jobs.begin(), m_jobs.begin() + m_next);
+    m_next = 0;
+}
+
+int pauseBeforeJob(SerialPort& serial, const std::string& nextPath) {
+    using clock = std::chrono::steady_clock;
+
+    int          retval   = 0;
+    auto         nextPoll = clock::now();
+    bool         held     = false;
+    LineReader   reader;
+    StatusReport report;
+
+    serial.setDirect();
+    serial.write('\f');  // Turn off echoing
+    serial.write("M0\n", 3);
+    infoColor();
+    std::cout << "Waiting for the machine to finish the previous job" << std::endl;
+    while (true) {
+        if (held && availConsoleChar()) {
+            int c = getConsoleChar();
+            if (c == '~') {
+                serial.write('~');  // Cycle start
+                break;
+            }
+            if (c == 0x1b) {
+                std::cout << "Queue stopped; the machine is held at M0" << std::endl;
+                retval = -1;
+                break;
+            }
+        }
+        auto now = clock::now();
+        if (now >= nextPoll) {
+            serial.write('?');
+            nextPoll = now + std::chrono::milliseconds(250);
+        }
+        int len = reader.read(serial, 50);
+        if (len <= 0 || !parseStatusReport(reader.line(), len, report)) {
+            continue;
+        }
+        if (!held && !strncmp(report.state, "Hold", 4)) {
+            held = true;
+            std::cout << "Next job: " << nextPath << std::endl;
+            std::cout << "Press ~ to start it, Esc to stop the queue" << std::endl;
+        }
+        if (!strncmp(report.state, "Alarm", 5)) {
+            std::cout << "Controller is in alarm state" << std::endl;
+            retval = -1;
+            break;
+        }
+    }
+    normalColor();
+    serial.setIndirect();
+    serial.write('\t');  // Echo mode on
+    return retval;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "SerialPort.h"
+#include "GCodeFile.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One file in the job queue
+struct QueuedJob {
+    enum State { PENDING, DONE, FAILED, SKIPPED };
+
+    std::string path;
+    State       state   = PENDING;
+    double      seconds = 0;  // streaming time
+    std::string error;        // preflight failure or why the job stopped
+
+    // Filled in by the prefetch thread before the job runs
+    bool                  prepared = false;
+    size_t                nonGCode = 0;  // lines sent as-is: $ commands, malformed words
+    std::vector<uint64_t> index;         // byte offset of every line
+    std::string           head;          // the start of the file, read ahead
+};
+
+// Reads a prepared job from its prefetched head, then from the file
+class JobSource : public std::streambuf {
+private:
+    const std::string& m_head;
+    GCodeFile          m_file;
+    std::vector<char>  m_buf;
+    uint64_t           m_bufPos;  // file offset of m_buf, or 0 in the head
+    bool               m_inHead;
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+public:
+    explicit JobSource(const QueuedJob& job);
+};
+
+// Files to run back to back.  While one job runs, a background thread
+// prepares the next: it checks every line, indexes the file and reads
+// its first few megabytes, so the next job starts without waiting on
+// the file system.  The thread starts with the first job added.
+class JobQueue {
+private:
+    std::vector<std::unique_ptr<QueuedJob>> m_jobs;
+    size_t                                  m_next = 0;  // next job to run
+    std::atomic<bool>                       m_stop { false };
+    bool                                    m_busy = false;  // preparing a job
+    mutable std::mutex                      m_mutex;
+    std::condition_variable                 m_changed;
+    std::thread                             m_worker;
+
+    void prefetch();
+
+public:
+    static const size_t PREFETCH_BYTES = 4 << 20;
+    static const size_t MAX_LINE       = 255;  // FluidNC's line buffer
+
+    ~JobQueue();
+
+    void   add(const std::string& path);
+    size_t pending() const;
+
+    // Waits until the next job is prepared and starts on the one after.
+    // Returns nullptr when the queue is empty.
+    QueuedJob* next();
+
+    // Marks the jobs that were not run as skipped
+    void skipRest();
+
+    // Prints one line per job, then forgets the jobs that have run
+    void report(std::ostream& out);
+};
+
+// Queues M0 behind the previous job, waits for the machine to reach it,
+// and lets the operator resume with cycle start.  Returns -1 if the
+// operator stops the queue instead.
+int pauseBeforeJob(SerialPort& serial, const std::string& nextPath);
@@ -0,0 +1,95 @@
+#include "LineEditor.h"
+#include "Console.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+// The next key.  The console may be non-blocking, so this waits.
+static int nextKey() {
+    int c;
+    while ((c = getConsoleChar()) < 0) {
+        if (!availConsoleChar()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    return c;
+}
+
+static void completeLine(const std::string& prompt, std::string& line, const Completer& complete) {
+    std::vector<std::string> choices = complete(line);
+    if (choices.empty()) {
+        std::cout << '\a' << std::flush;
+        return;
+    }
+    std::string common = choices[0];
+    for (auto& choice : choices) {
+        size_t n = 0;
+        while (n < common.length() && n < choice.length() && common[n] == choice[n]) {
+            ++n;
+        }
+        common.erase(n);
+    }
+    if (choices.size() > 1) {
+        std::cout << std::endl;
+        for (auto& choice : choices) {
+            std::cout << choice << "  ";
+        }
+        std::cout << std::endl << prompt << line;
+    }
+    if (common.length() > line.length()) {
+        std::cout << common.substr(line.length());
+        line = common;
+    }
+    std::cout << std::flush;
+}
+
+bool editLine(const std::string& prompt, std::string& line, const Completer& complete) {
+    line.clear();
+    std::cout << prompt << std::flush;
+    while (true) {
+        int c = nextKey();
+        switch (c) {
+            case '\r':
+            case '\n':
+                std::cout << std::endl;
+                return true;
+            case '\t':
+                if (complete) {
+                    completeLine(prompt, line, complete);
+                }
+                break;
+            case '\b':
+            case 0x7f:
+                if (line.length()) {
+                    line.pop_back();
+                    std::cout << "\b \b" << std::flush;
+                }
+                break;
+            case 0x15:  // Ctrl-U
+                while (line.length()) {
+                    line.pop_back();
+                    std::cout << "\b \b";
+                }
+                std::cout << std::flush;
+                break;
+            case 0x03:  // Ctrl-C
+                std::cout << std::endl;
+                return false;
+            case 0x1b:
+                // A key like an arrow sends a sequence at once; Escape alone does not
+                if (!availConsoleChar()) {
+                    std::cout << std::endl;
+                    return false;
+                }
+                while ((c = nextKey()) == '[' || c == ';' || (c >= '0' && c <= '9')) {
+                }
+                break;
+            default:
+                if (c >= ' ') {
+                    line += char(c);
+                    std::cout << char(c) << std::flush;
+                }
+                break;
+        }
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::function<std::vector<std::string>(const std::string&)> Completer;
+
+// Reads a line from the console in its normal raw mode, echoing as it
+// goes.  Tab asks `complete` how the line can go on: a single choice is
+// filled in, while several are listed and the start they share is
+// filled in.  Backspace erases and Ctrl-U clears the line.  Escape or
+// Ctrl-C gives up and returns false.
+bool editLine(const std::string& prompt, std::string& line, const Completer& complete = nullptr);
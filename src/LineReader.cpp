@@ -0,0 +1,27 @@
+#include "LineReader.h"
+#include <cstring>
+
+int LineReader::read(SerialPort& serial, uint32_t ms) {
+    while (true) {
+        int c = serial.timedRead(ms);
+        if (c == -1) {
+            return -1;
+        }
+        if (c == '\n') {
+            size_t len = m_len;
+            if (len && m_line[len - 1] == '\r') {
+                --len;
+            }
+            m_line[len] = '\0';
+            m_len       = 0;
+            return int(len);
+        }
+        if (m_len < sizeof(m_line) - 1) {
+            m_line[m_len++] = c;
+        }
+    }
+}
+
+bool LineReader::startsWith(const char* prefix) const {
+    return strncmp(m_line, prefix, strlen(prefix)) == 0;
+}
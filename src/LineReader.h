@@ -0,0 +1,21 @@
+#pragma once
+
+#include "SerialPort.h"
+#include <cstddef>
+
+// Assembles serial input into lines in a fixed buffer, so response
+// parsing does not allocate.  Overlong lines are truncated.
+class LineReader {
+private:
+    char   m_line[256];
+    size_t m_len = 0;
+
+public:
+    // Returns the length of the next line without its line ending, or -1
+    // if `ms` passes without a character.  A partial line is kept for
+    // the next call.
+    int read(SerialPort& serial, uint32_t ms);
+
+    const char* line() const { return m_line; }
+    bool        startsWith(const char* prefix) const;
+};
@@ -0,0 +1,195 @@
+#include "LinkAnalysis.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// One line as sent
+struct Segment {
+    size_t   line;     // source line
+    uint32_t bytes;    // including the newline
+    double   seconds;  // execution time, 0 for non-motion lines
+    double   length;   // mm
+};
+
+static const double TWO_PI = 6.283185307179586;
+
+// Path length in program units of the move from `from` to state.pos
+static double moveLength(const GCodeState& state, const GCodeBlock& block, const double (&from)[3]) {
+    const double* to = state.pos;
+    double        dx = to[0] - from[0];
+    double        dy = to[1] - from[1];
+    double        dz = to[2] - from[2];
+    if (state.motion != 2 && state.motion != 3) {
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    double angle;
+    double r;
+    if (block.has('R')) {
+        r        = std::fabs(block.value('R', 0));
+        double c = std::hypot(dx, dy);
+        if (r <= 0 || c > 2 * r) {
+            return std::hypot(c, dz);
+        }
+        angle = 2 * std::asin(c / (2 * r));
+        if (block.value('R', 0) < 0) {
+            angle = TWO_PI - angle;
+        }
+    } else {
+        double cx = from[0] + block.value('I', 0);
+        double cy = from[1] + block.value('J', 0);
+        double a0 = std::atan2(from[1] - cy, from[0] - cx);
+        double a1 = std::atan2(to[1] - cy, to[0] - cx);
+        r         = std::hypot(from[0] - cx, from[1] - cy);
+        angle     = state.motion == 2 ? a0 - a1 : a1 - a0;
+        if (angle <= 1e-9) {
+            angle += TWO_PI;
+        }
+    }
+    return std::hypot(r * angle, dz);
+}
+
+static void addLine(const char* line, size_t len, size_t lineNumber, const LinkModel& model, GCodeState& state, std::vector<Segment>& segments) {
+    Segment    seg { lineNumber, uint32_t(len + 1), 0, 0 };
+    GCodeBlock block;
+    double     from[3];
+    if (parseGCode(line, len, block)) {
+        state.update(block, from);
+        if (block.hasG(4)) {
+            seg.seconds = block.value('P', 0);
+        } else if (state.isMotion(block)) {
+            seg.length  = state.toMm(moveLength(state, block, from));
+            double feed = state.motion == 0 ? model.rapid : state.toMm(state.feed);
+            if (feed > 0) {
+                seg.seconds = seg.length / feed * 60;
+            }
+        }
+    }
+    segments.push_back(seg);
+}
+
+// Replays the job over the link.  Returns the time the planner spent
+// empty, and collects the starved stretches if `regions` is given.
+static double simulate(const std::vector<Segment>& segments, const LinkModel& model, uint32_t baud, std::vector<StarvedRegion>* regions) {
+    const double        byteTime = 10.0 / baud;  // 8N1
+    std::vector<double> ends(model.plannerBlocks, 0);
+    size_t              queued      = 0;
+    double              linkFree    = 0;  // when the next line can start
+    double              machineFree = 0;  // when the queued motion ends
+    double              idle        = 0;
+
+    for (const Segment& seg : segments) {
+        double arrived = linkFree + seg.bytes * byteTime;
+        if (seg.seconds > 0) {
+            if (queued >= ends.size()) {
+                // The planner is full; the line waits for the oldest block
+                arrived = std::max(arrived, ends[queued % ends.size()]);
+            }
+            if (queued && arrived > machineFree) {
+                double gap = arrived - machineFree;
+                idle += gap;
+                if (regions) {
+                    if (regions->empty() || seg.line > regions->back().lastLine + 50) {
+                        regions->push_back({ seg.line, seg.line, 0, 0, 0 });
+                    }
+                    StarvedRegion& r = regions->back();
+                    r.lastLine       = seg.line;
+                    r.segments++;
+                    r.idle += gap;
+                    r.length += seg.length;
+                }
+            }
+            machineFree                = std::max(arrived, machineFree) + seg.seconds;
+            ends[queued % ends.size()] = machineFree;
+            ++queued;
+        }
+        linkFree = arrived;
+        if (model.stopAndWait) {
+            linkFree += model.latency + 4 * byteTime;  // "ok\r\n"
+        }
+    }
+    return idle;
+}
+
+void analyzeLink(std::istream& in, GCodeTransform* transform, const LinkModel& model, LinkReport& report) {
+    report = LinkReport { 0, 0, 0, 0, 0, {} };
+
+    std::vector<Segment> segments;
+    GCodeState           state;
+    std::string          out;
+    size_t               lineNumber = 0;
+    for (std::string line; std::getline(in, line);) {
+        ++lineNumber;
+        if (line.length() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!transform) {
+            addLine(line.c_str(), line.length(), lineNumber, model, state, segments);
+            continue;
+        }
+        out.clear();
+        transform->apply(line.c_str(), line.length(), out);
+        size_t start = 0;
+        size_t end;
+        while ((end = out.find('\n', start)) != std::string::npos) {
+            addLine(out.c_str() + start, end - start, lineNumber, model, state, segments);
+            start = end + 1;
+        }
+    }
+
+    report.lines = lineNumber;
+    for (const Segment& seg : segments) {
+        report.bytes += seg.bytes;
+        report.motionTime += seg.seconds;
+    }
+    report.idleTime = simulate(segments, model, model.baud, &report.regions);
+    std::sort(report.regions.begin(), report.regions.end(), [](const StarvedRegion& a, const StarvedRegion& b) { return a.idle > b.idle; });
+
+    // The planner may idle for up to 1% of the job
+    static const uint32_t rates[] = { 115200, 230400, 460800, 921600, 1000000, 1500000, 2000000 };
+    for (uint32_t baud : rates) {
+        if (simulate(segments, model, baud, nullptr) <= report.motionTime * 0.01) {
+            report.minBaud = baud;
+            break;
+        }
+    }
+}
+
+void printLinkReport(const LinkReport& report, const LinkModel& model, std::ostream& out) {
+    out << report.lines << " lines, " << report.bytes << " bytes, " << report.motionTime << " s of motion at programmed feeds" << std::endl;
+    out << "At " << model.baud << " baud the planner is empty for " << report.idleTime << " s";
+    if (report.motionTime > 0) {
+        out << " (" << int(100 * report.idleTime / report.motionTime + 0.5) << "%)";
+    }
+    out << std::endl;
+
+    const size_t shown = std::min<size_t>(report.regions.size(), 10);
+    for (size_t i = 0; i < shown; ++i) {
+        const StarvedRegion& r = report.regions[i];
+        out << "  lines " << r.firstLine << "-" << r.lastLine << ": " << r.segments << " starved segments averaging "
+            << r.length / r.segments << " mm, " << r.idle << " s idle" << std::endl;
+    }
+    if (report.regions.size() > shown) {
+        out << "  ... " << report.regions.size() - shown << " more regions" << std::endl;
+    }
+
+    if (report.idleTime <= report.motionTime * 0.01) {
+        out << "The link keeps up with this job" << std::endl;
+        return;
+    }
+    if (report.minBaud > model.baud) {
+        out << "Recommend at least " << report.minBaud << " baud" << std::endl;
+    }
+    double length  = 0;
+    size_t starved = 0;
+    for (const StarvedRegion& r : report.regions) {
+        length += r.length;
+        starved += r.segments;
+    }
+    if (starved && length / starved < 0.5) {
+        out << "Starved segments average " << length / starved
+            << " mm; merging short collinear moves or fitting arcs in the CAM output would reduce the line count" << std::endl;
+    }
+    if (report.minBaud == 0 || report.minBaud > model.baud) {
+        out << "Running the job from the controller's SD card (--run-remote) avoids the serial link entirely" << std::endl;
+    }
+}
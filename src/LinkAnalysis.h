@@ -0,0 +1,43 @@
+#pragma once
+
+#include "GCode.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// How lines get from FluidTerm into the controller's planner
+struct LinkModel {
+    uint32_t baud          = 115200;
+    bool     stopAndWait   = true;   // wait for "ok" per line, as sendGCode does
+    double   latency       = 0.002;  // s, turnaround per line in stop-and-wait
+    int      plannerBlocks = 16;     // motion blocks FluidNC can queue
+    double   rapid         = 5000;   // mm/min, used for G0
+};
+
+// Consecutive stretch of the job where the planner ran empty
+struct StarvedRegion {
+    size_t firstLine, lastLine;  // 1-based source lines
+    size_t segments;             // starved motion segments
+    double idle;                 // s the machine waited for the link
+    double length;               // mm moved by the starved segments
+};
+
+struct LinkReport {
+    size_t                     lines;
+    uint64_t                   bytes;
+    double                     motionTime;  // s, if the link were infinitely fast
+    double                     idleTime;    // s the planner spent empty
+    uint32_t                   minBaud;     // lowest standard rate that keeps up, 0 if none
+    std::vector<StarvedRegion> regions;     // worst first
+};
+
+// Predicts where the serial link cannot keep the planner fed.  Each
+// line is timed at its programmed feed with no acceleration, which is
+// the fastest the machine can consume it, against the time to send it
+// at the model's baud rate.  `transform`, if any, is applied first,
+// as it would be when sending.
+void analyzeLink(std::istream& in, GCodeTransform* transform, const LinkModel& model, LinkReport& report);
+
+// Prints the regions and the recommendations
+void printLinkReport(const LinkReport& report, const LinkModel& model, std::ostream& out);
@@ -0,0 +1,45 @@
+#include "LinkTiming.h"
+#include <algorithm>
+#include <cmath>
+
+void LinkTiming::sample(double ms, size_t bytes) {
+    double rtt = std::max(0.0, ms - sendTime(bytes));
+    if (!m_valid) {
+        m_srtt   = rtt;
+        m_rttvar = rtt / 2;
+        m_valid  = true;
+    } else {
+        m_rttvar = 0.75 * m_rttvar + 0.25 * std::fabs(m_srtt - rtt);
+        m_srtt   = 0.875 * m_srtt + 0.125 * rtt;
+    }
+    m_backoff = 0;
+}
+
+void LinkTiming::backoff() {
+    if (m_backoff < 16) {
+        ++m_backoff;
+    }
+}
+
+static uint32_t clamp(double ms, uint32_t limit) {
+    return uint32_t(std::min(double(limit), std::max(double(LinkTiming::MIN_TIMEOUT), ms)));
+}
+
+uint32_t LinkTiming::due(uint32_t limit, size_t bytes) const {
+    if (!m_valid) {
+        return limit;
+    }
+    return clamp(m_srtt + std::max(10.0, 4 * m_rttvar) + sendTime(bytes), limit);
+}
+
+uint32_t LinkTiming::timeout(uint32_t limit, size_t bytes) const {
+    if (!m_valid) {
+        return limit;
+    }
+    return clamp((m_srtt + std::max(10.0, 4 * m_rttvar) + sendTime(bytes)) * (1 << m_backoff), limit);
+}
+
+LinkTiming& linkTiming() {
+    static LinkTiming timing;
+    return timing;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Estimates how long the controller takes to answer, from round trips
+// measured while the protocols run, and sets the retry timeout from it
+// the way TCP does (RFC 6298): the smoothed round trip plus four times
+// its mean deviation, doubled after each timeout until a new sample.
+// The time to send a packet at the line rate is kept out of the
+// samples and added back per wait, so short and long packets share one
+// estimate.
+class LinkTiming {
+private:
+    double   m_srtt    = 0;  // ms
+    double   m_rttvar  = 0;  // ms
+    bool     m_valid   = false;
+    int      m_backoff = 0;
+    uint32_t m_baud    = 115200;
+
+public:
+    static const uint32_t MIN_TIMEOUT = 30;  // ms, covers the port's timer and USB frame jitter
+
+    void setBaud(uint32_t baud) { m_baud = baud; }
+
+    // Milliseconds to send `bytes` at the line rate
+    double sendTime(size_t bytes) const { return bytes * 10000.0 / m_baud; }
+
+    // A request of `bytes` was answered `ms` after it was written.  Only
+    // pass requests sent once, since an answer to a resend could belong
+    // to either copy.
+    void sample(double ms, size_t bytes = 0);
+
+    // A wait timed out
+    void backoff();
+
+    // How long to wait for the answer to a request of `bytes`, at most
+    // `limit`.  Until there are samples, `limit`.
+    uint32_t timeout(uint32_t limit, size_t bytes = 0) const;
+
+    // The same without the backoff: when an answer is due if the
+    // request got through
+    uint32_t due(uint32_t limit, size_t bytes = 0) const;
+
+    bool   valid() const { return m_valid; }
+    double srtt() const { return m_srtt; }
+    double rttvar() const { return m_rttvar; }
+};
+
+// The timing of the one serial link in use
+LinkTiming& linkTiming();
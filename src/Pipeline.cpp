@@ -0,0 +1,437 @@
+#include "Pipeline.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t nanoseconds(Clock::duration d) {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+// Measures the time a stage spends working between batches
+class BusyTimer {
+private:
+    Clock::time_point m_mark = Clock::now();
+    uint64_t          m_waited = 0;
+
+public:
+    void wait(Clock::time_point since) { m_waited += nanoseconds(Clock::now() - since); }
+
+    void publish(StageCounters& counters) {
+        auto     now   = Clock::now();
+        uint64_t total = nanoseconds(now - m_mark);
+        counters.busyNs += total > m_waited ? total - m_waited : 0;
+        m_mark   = now;
+        m_waited = 0;
+    }
+};
+
+Pipeline::Pipeline(std::istream& in) : m_in(in) {
+    m_counters.emplace_back(new StageCounters);
+    m_counters[0]->name = "lexer";
+}
+
+Pipeline::~Pipeline() {
+    m_stop = true;
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+void Pipeline::add(GCodeTransform* stage) {
+    auto chain = dynamic_cast<TransformChain*>(stage);
+    if (chain) {
+        for (GCodeTransform* s : chain->stages()) {
+            add(s);
+        }
+        return;
+    }
+    m_stages.push_back(stage);
+    m_counters.emplace_back(new StageCounters);
+    m_counters.back()->name = stage->name();
+}
+
+void Pipeline::start() {
+    for (size_t i = 0; i <= m_stages.size(); ++i) {
+        m_links.emplace_back(new Link);
+        for (LineBatch& batch : m_links.back()->batches) {
+            batch.text.reserve(2 * LineBatch::MAX_BYTES);
+            batch.ends.reserve(2 * LineBatch::MAX_LINES);
+            batch.source.reserve(2 * LineBatch::MAX_LINES);
+            m_links.back()->free.push(&batch);
+        }
+    }
+    m_threads.emplace_back(&Pipeline::lex, this);
+    for (size_t i = 0; i < m_stages.size(); ++i) {
+        m_threads.emplace_back(&Pipeline::transform, this, i);
+    }
+}
+
+// Waits for a batch, spinning briefly before backing off to sleeps.
+// Returns false if the pipeline is being torn down.
+bool Pipeline::take(SpscQueue<LineBatch*, QUEUE_SIZE>& queue, LineBatch*& batch) {
+    for (int spins = 0; !queue.pop(batch); ++spins) {
+        if (m_stop) {
+            return false;
+        }
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    return true;
+}
+
+// Each link owns one batch fewer than its queues hold, so this cannot fail
+void Pipeline::give(SpscQueue<LineBatch*, QUEUE_SIZE>& queue, LineBatch* batch) {
+    queue.push(batch);
+}
+
+void Pipeline::lex() {
+    Link&             link     = *m_links[0];
+    StageCounters&    counters = *m_counters[0];
+    BusyTimer         timer;
+    std::vector<char> buf(1 << 16);
+    char*             data   = buf.data();
+    size_t            start  = 0;
+    size_t            end    = 0;
+    bool              eof    = false;
+    uint32_t          lineNo = 0;
+    LineBatch*        batch;
+
+    auto waitFor = [&](LineBatch*& b) {
+        auto since = Clock::now();
+        bool ok    = take(link.free, b);
+        timer.wait(since);
+        b->clear();
+        return ok;
+    };
+    if (!waitFor(batch)) {
+        return;
+    }
+    while (!m_stop) {
+        char* nl = static_cast<char*>(memchr(data + start, '\n', end - start));
+        if (!nl && end - start == buf.size()) {
+            nl = data + end;  // Overlong line
+        } else if (!nl && eof) {
+            if (start == end) {
+                break;
+            }
+            nl = data + end;  // Last line without a newline
+        } else if (!nl) {
+            memmove(data, data + start, end - start);
+            end -= start;
+            start = 0;
+            m_in.read(data + end, buf.size() - end);
+            size_t n = size_t(m_in.gcount());
+            end += n;
+            if (n == 0) {
+                eof = true;
+                if (m_in.bad()) {
+                    m_bad = true;
+                }
+            }
+            continue;
+        }
+        const char* line = data + start;
+        size_t      len  = nl - line;
+        if (len && line[len - 1] == '\r') {
+            --len;
+        }
+        start = nl - data + (nl < data + end);
+
+        batch->text.append(line, len);
+        batch->text += '\n';
+        batch->ends.push_back(uint32_t(batch->text.length() - 1));
+        batch->source.push_back(++lineNo);
+        if (batch->full()) {
+            counters.linesOut += batch->ends.size();
+            counters.bytesOut += batch->text.length();
+            timer.publish(counters);
+            give(link.full, batch);
+            if (!waitFor(batch)) {
+                return;
+            }
+        }
+    }
+    counters.linesOut += batch->ends.size();
+    counters.bytesOut += batch->text.length();
+    timer.publish(counters);
+    batch->last = true;
+    give(link.full, batch);
+}
+
+void Pipeline::transform(size_t index) {
+    Link&           in       = *m_links[index];
+    Link&           out      = *m_links[index + 1];
+    GCodeTransform* stage    = m_stages[index];
+    StageCounters&  counters = *m_counters[index + 1];
+    BusyTimer       timer;
+    LineBatch*      src;
+    LineBatch*      dst;
+
+    auto waitFor = [&](SpscQueue<LineBatch*, QUEUE_SIZE>& queue, LineBatch*& b) {
+        auto since = Clock::now();
+        bool ok    = take(queue, b);
+        timer.wait(since);
+        return ok;
+    };
+    auto publish = [&]() {
+        counters.linesOut += dst->ends.size();
+        counters.bytesOut += dst->text.length();
+        timer.publish(counters);
+        give(out.full, dst);
+    };
+
+    if (!waitFor(out.free, dst)) {
+        return;
+    }
+    dst->clear();
+    while (waitFor(in.full, src)) {
+        size_t begin = 0;
+        for (size_t k = 0; k < src->ends.size(); ++k) {
+            size_t before = dst->text.length();
+            stage->apply(src->text.data() + begin, src->ends[k] - begin, dst->text);
+            begin = src->ends[k] + 1;
+            for (size_t p = before; (p = dst->text.find('\n', p)) != std::string::npos; ++p) {
+                dst->ends.push_back(uint32_t(p));
+                dst->source.push_back(src->source[k]);
+            }
+            if (dst->full()) {
+                publish();
+                if (!waitFor(out.free, dst)) {
+                    return;
+                }
+                dst->clear();
+            }
+        }
+        counters.linesIn += src->ends.size();
+        bool last = src->last;
+        give(in.free, src);
+        if (last) {
+            dst->last = true;
+            publish();
+            return;
+        }
+    }
+}
+
+bool Pipeline::next(const char*& line, size_t& len, size_t& sourceLine) {
+    Link& link = *m_links.back();
+    while (!m_done) {
+        if (m_current && m_line < m_current->ends.size()) {
+            size_t begin = m_line ? m_current->ends[m_line - 1] + 1 : 0;
+            line         = m_current->text.data() + begin;
+            len          = m_current->ends[m_line] - begin;
+            sourceLine   = m_current->source[m_line];
+            ++m_line;
+            return true;
+        }
+        if (m_current) {
+            m_done = m_current->last;
+            give(link.free, m_current);
+            m_current = nullptr;
+            continue;
+        }
+        if (!take(link.full, m_current)) {
+            return false;
+        }
+        m_line = 0;
+    }
+    return false;
+}
+
+void Pipeline::report(std::ostream& out) const {
+    for (size_t i = 0; i < m_counters.size(); ++i) {
+        const StageCounters& c     = *m_counters[i];
+        double               busy  = c.busyNs / 1e9;
+        uint64_t             lines = i ? c.linesIn.load() : c.linesOut.load();
+        char                 text[120];
+        snprintf(text,
+                 sizeof(text),
+                 "  %-10s %10lu lines in %10lu out %8.3f s busy %12.0f lines/s",
+                 c.name,
+                 (unsigned long)lines,
+                 (unsigned long)c.linesOut.load(),
+                 busy,
+                 busy > 0 ? lines / busy : 0.0);
+        out << text << std::endl;
+    }
+}
+
+static void passThrough(const char* line, size_t len, std::string& out) {
+    out.append(line, len);
+    out += '\n';
+}
+
+// Length of the number starting at p, as parseGCode reads it
+static size_t numberLength(const char* p, const char* end) {
+    const char* q = p;
+    if (q < end && (*q == '-' || *q == '+')) {
+        ++q;
+    }
+    while (q < end && *q >= '0' && *q <= '9') {
+        ++q;
+    }
+    if (q < end && *q == '.') {
+        ++q;
+        while (q < end && *q >= '0' && *q <= '9') {
+            ++q;
+        }
+    }
+    return q - p;
+}
+
+bool ModalTracker::track() {
+    bool   feedKept = true;
+    double from[3];
+    m_state.update(m_block, from);
+    for (int i = 0; i < m_block.nwords; ++i) {
+        const GCodeWord& w = m_block.words[i];
+        if (w.letter != 'G') {
+            continue;
+        }
+        if (w.value == 0 || w.value == 1 || w.value == 2 || w.value == 3) {
+            m_motion = int(w.value);
+        } else if ((w.value > 38 && w.value < 39) || (w.value >= 80 && w.value <= 89)) {
+            m_motion = -1;
+        } else if (w.value == 93 || w.value == 94) {
+            // The controller forgets the feed when the feed mode changes
+            feedKept      = false;
+            m_inverseTime = w.value == 93;
+        }
+    }
+    m_feedKnown = !m_inverseTime && ((m_feedKnown && feedKept) || m_block.has('F'));
+    return feedKept;
+}
+
+void ModalTracker::bypassed(const char* line, size_t len) {
+    while (len && (line[len - 1] == '\r' || line[len - 1] == '\n')) {
+        --len;
+    }
+    if (parseGCode(line, len, m_block)) {
+        track();
+    }
+}
+
+void ModalTracker::apply(const char* line, size_t len, std::string& out) {
+    if (!parseGCode(line, len, m_block)) {
+        passThrough(line, len, out);
+        return;
+    }
+    int    motion    = m_motion;
+    bool   feedKnown = m_feedKnown;
+    double feed      = m_state.feed;
+    feedKnown        = track() && feedKnown;
+    if (!m_drop) {
+        passThrough(line, len, out);
+        return;
+    }
+
+    // Copy the line, leaving out the redundant words.  Words are matched
+    // to the parsed block in order; N words are not in the block.
+    const char* p    = line;
+    const char* end  = line + len;
+    int         word = 0;
+    while (p < end) {
+        char c = *p;
+        if (c == '(') {
+            const char* close = static_cast<const char*>(memchr(p, ')', end - p));
+            const char* stop  = close ? close + 1 : end;
+            out.append(p, stop - p);
+            p = stop;
+            continue;
+        }
+        if (c == ';') {
+            out.append(p, end - p);
+            break;
+        }
+        char upper = c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+        if (upper < 'A' || upper > 'Z') {
+            out += c;
+            ++p;
+            continue;
+        }
+        size_t n    = 1 + numberLength(p + 1, end);
+        bool   drop = false;
+        if (upper != 'N') {
+            const GCodeWord& w = m_block.words[word++];
+            if (w.letter == 'G' && motion >= 0 && w.value == motion) {
+                drop = true;
+            } else if (w.letter == 'F' && feedKnown && !m_inverseTime && w.value == feed) {
+                drop = true;
+            }
+        }
+        if (!drop) {
+            out.append(p, n);
+        }
+        p += n;
+    }
+    out += '\n';
+}
+
+void Encoder::apply(const char* line, size_t len, std::string& out) {
+    if (!m_compact || !parseGCode(line, len, m_block)) {
+        passThrough(line, len, out);
+        return;
+    }
+    size_t      before = out.length();
+    const char* p      = line;
+    const char* end    = line + len;
+    while (p < end) {
+        char c = *p;
+        if (c == '(') {
+            const char* close = static_cast<const char*>(memchr(p, ')', end - p));
+            const char* stop  = close ? close + 1 : end;
+            if (stop - p >= 4 && !strncmp(p + 1, "MSG", 3)) {
+                out.append(p, stop - p);
+            }
+            p = stop;
+            continue;
+        }
+        if (c == ';') {
+            break;
+        }
+        if (c != ' ' && c != '\t') {
+            out += c;
+        }
+        ++p;
+    }
+    if (out.length() != before) {
+        out += '\n';
+    }
+}
+
+void benchmarkPipeline(std::istream& in, const std::vector<GCodeTransform*>& stages, std::ostream& out) {
+    Pipeline pipeline(in);
+    for (GCodeTransform* stage : stages) {
+        pipeline.add(stage);
+    }
+    auto start = Clock::now();
+    pipeline.start();
+
+    const char* line;
+    size_t      len;
+    size_t      sourceLine;
+    uint64_t    lines = 0;
+    uint64_t    bytes = 0;
+    while (pipeline.next(line, len, sourceLine)) {
+        ++lines;
+        bytes += len + 1;
+    }
+    double seconds = nanoseconds(Clock::now() - start) / 1e9;
+
+    char text[120];
+    snprintf(text,
+             sizeof(text),
+             "%lu lines, %lu bytes out in %.3f s: %.0f lines/s, %.1f MB/s",
+             (unsigned long)lines,
+             (unsigned long)bytes,
+             seconds,
+             seconds > 0 ? lines / seconds : 0.0,
+             seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+    out << text << std::endl;
+    pipeline.report(out);
+}
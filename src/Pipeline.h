@@ -0,0 +1,138 @@
+#pragma once
+
+#include "GCode.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A batch of lines passed between pipeline stages.  The text holds the
+// lines back to back, each ending in '\n'.
+struct LineBatch {
+    static const size_t MAX_LINES = 256;
+    static const size_t MAX_BYTES = 32 << 10;
+
+    std::string           text;
+    std::vector<uint32_t> ends;    // offset of each line's '\n'
+    std::vector<uint32_t> source;  // source line number of each line
+    bool                  last;    // no batches follow
+
+    void clear() {
+        text.clear();
+        ends.clear();
+        source.clear();
+        last = false;
+    }
+    bool full() const { return ends.size() >= MAX_LINES || text.length() >= MAX_BYTES; }
+};
+
+// Work done by one stage, updated once per batch
+struct StageCounters {
+    const char*           name;
+    std::atomic<uint64_t> linesIn { 0 };
+    std::atomic<uint64_t> linesOut { 0 };
+    std::atomic<uint64_t> bytesOut { 0 };
+    std::atomic<uint64_t> busyNs { 0 };  // time spent working, not waiting
+};
+
+// Moves G-code from a stream to the serial writer through a chain of
+// stages, each on its own thread.  The lexer splits the source into
+// lines; every added stage is a GCodeTransform.  Stages hand batches of
+// lines to each other over bounded lock-free queues and recycle them,
+// so steady-state streaming does not allocate, and the writer only
+// waits if every stage ahead of it has fallen behind.
+class Pipeline {
+private:
+    static const size_t QUEUE_SIZE = 8;  // batches per link
+
+    struct Link {
+        SpscQueue<LineBatch*, QUEUE_SIZE> full;
+        SpscQueue<LineBatch*, QUEUE_SIZE> free;
+        LineBatch                         batches[QUEUE_SIZE - 1];
+    };
+
+    std::istream&                               m_in;
+    std::vector<GCodeTransform*>                m_stages;
+    std::vector<std::unique_ptr<StageCounters>> m_counters;  // [0] is the lexer
+    std::vector<std::unique_ptr<Link>>          m_links;     // [i] feeds stage i
+    std::vector<std::thread>                    m_threads;
+    std::atomic<bool>                           m_stop { false };
+    std::atomic<bool>                           m_bad { false };
+
+    LineBatch* m_current = nullptr;  // batch being read by next()
+    size_t     m_line    = 0;
+    bool       m_done    = false;
+
+    bool take(SpscQueue<LineBatch*, QUEUE_SIZE>& queue, LineBatch*& batch);
+    void give(SpscQueue<LineBatch*, QUEUE_SIZE>& queue, LineBatch* batch);
+    void lex();
+    void transform(size_t stage);
+
+public:
+    explicit Pipeline(std::istream& in);
+    ~Pipeline();
+
+    // Stages run in the order added.  A TransformChain is split into
+    // its stages so each gets its own thread.  Call before start().
+    void add(GCodeTransform* stage);
+    void start();
+
+    // The next output line, without its '\n'.  Returns false at the end.
+    bool next(const char*& line, size_t& len, size_t& sourceLine);
+
+    // True if reading the source failed
+    bool bad() const { return m_bad; }
+
+    // Lines per second of busy time for each stage
+    void report(std::ostream& out) const;
+};
+
+// Tracks the modal state line by line.  With `dropRedundant`, removes
+// G0-G3 and F words that repeat the current mode, which shortens the
+// lines sent without changing what the controller does.
+class ModalTracker : public GCodeTransform {
+private:
+    bool       m_drop;
+    bool       m_inverseTime = false;
+    bool       m_feedKnown   = false;  // the controller has a G94 feed
+    int        m_motion      = -1;  // G0-G3, -1 after a probe or canned cycle
+    GCodeState m_state;
+    GCodeBlock m_block;
+
+    // Applies m_block to the state.  Returns false if it changes the
+    // feed mode, which makes the controller forget the feed.
+    bool track();
+
+public:
+    explicit ModalTracker(bool dropRedundant = false) : m_drop(dropRedundant) {}
+
+    const char*       name() const override { return "modal"; }
+    void              apply(const char* line, size_t len, std::string& out) override;
+    void              bypassed(const char* line, size_t len) override;
+    const GCodeState& state() const { return m_state; }
+};
+
+// Produces the bytes sent for each line.  With `compact`, whitespace
+// and comments are removed from G-code lines and lines that end up
+// empty are not sent at all, which saves a round trip each.  MSG
+// comments and FluidNC $ commands are left alone.
+class Encoder : public GCodeTransform {
+private:
+    bool       m_compact;
+    GCodeBlock m_block;
+
+public:
+    explicit Encoder(bool compact = false) : m_compact(compact) {}
+
+    const char* name() const override { return "encoder"; }
+    void        apply(const char* line, size_t len, std::string& out) override;
+};
+
+// Runs the source through the stages as fast as they go and prints
+// the throughput of each
+void benchmarkPipeline(std::istream& in, const std::vector<GCodeTransform*>& stages, std::ostream& out);
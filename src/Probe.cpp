@@ -0,0 +1,190 @@
+#include "Probe.h"
+#include "LineReader.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+// Bytes we allow in the controller's receive buffer.  Grbl's buffer
+// is 128 bytes; FluidNC's is larger, so this is conservative.
+static const int RX_BUFFER_SIZE = 128;
+
+// Commands sent but not yet answered with ok or error
+struct Pending {
+    int len;
+    int point;  // grid point index for G38.2, otherwise -1
+};
+static const int MAX_PENDING = 32;
+
+// Returns the grid indices of the n'th probe point.  Rows alternate
+// direction so travel between points is always one step.
+static void gridPoint(const ProbeGrid& grid, int n, int& ix, int& iy) {
+    iy = n / grid.nx;
+    ix = n % grid.nx;
+    if (iy & 1) {
+        ix = grid.nx - 1 - ix;
+    }
+}
+
+// Formats the step'th command of the probing sequence into buf.
+// Returns the length, or 0 when the sequence is finished.
+static int probeCommand(const ProbeGrid& grid, int step, char* buf, size_t size, int& point) {
+    int npoints = grid.nx * grid.ny;
+    point       = -1;
+    if (step == 0) {
+        return snprintf(buf, size, "G90G0Z%.3f\n", grid.clearance);
+    }
+    --step;
+    if (step >= npoints * 3) {
+        return 0;
+    }
+    int    n = step / 3;
+    int    ix, iy;
+    double dx = (grid.x1 - grid.x0) / (grid.nx - 1);
+    double dy = (grid.y1 - grid.y0) / (grid.ny - 1);
+    gridPoint(grid, n, ix, iy);
+    switch (step % 3) {
+        case 0:
+            return snprintf(buf, size, "G0X%.3fY%.3f\n", grid.x0 + ix * dx, grid.y0 + iy * dy);
+        case 1:
+            point = n;
+            return snprintf(buf, size, "G38.2Z%.3fF%.1f\n", grid.depth, grid.feed);
+        default:
+            return snprintf(buf, size, "G0Z%.3f\n", grid.clearance);
+    }
+}
+
+// Parses "[PRB:x,y,z...:1]" without allocating.  Returns false if the
+// line is not a probe report.
+static bool parsePrb(const char* line, double& z, bool& success) {
+    if (strncmp(line, "[PRB:", 5) != 0) {
+        return false;
+    }
+    const char* p = line + 5;
+    char*       end;
+    for (int axis = 0; axis < 3; ++axis) {
+        double v = strtod(p, &end);
+        if (end == p) {
+            return false;
+        }
+        z = v;
+        p = end + 1;
+    }
+    const char* colon = strchr(end, ':');
+    success           = colon && colon[1] == '1';
+    return true;
+}
+
+int probeGrid(SerialPort& serial, const ProbeGrid& corners, HeightMap& map) {
+    if (corners.nx < 2 || corners.ny < 2) {
+        std::cout << "Probe grid needs at least 2x2 points" << std::endl;
+        return -1;
+    }
+    // The map's spacing must be positive, so corners given in reverse
+    // are swapped, and a grid with no width or depth is refused
+    ProbeGrid grid = corners;
+    if (grid.x1 < grid.x0) {
+        std::swap(grid.x0, grid.x1);
+    }
+    if (grid.y1 < grid.y0) {
+        std::swap(grid.y0, grid.y1);
+    }
+    if (!(grid.x1 > grid.x0) || !(grid.y1 > grid.y0)) {
+        std::cout << "Probe grid corners must differ in both X and Y" << std::endl;
+        return -1;
+    }
+    map.setGrid(grid.x0, grid.y0, (grid.x1 - grid.x0) / (grid.nx - 1), (grid.y1 - grid.y0) / (grid.ny - 1), grid.nx, grid.ny);
+    int npoints = grid.nx * grid.ny;
+
+    Pending    pending[MAX_PENDING];
+    int        head = 0, count = 0, inflight = 0;
+    int        step = 0, probed = 0;
+    bool       more = true;
+    double     z0   = 0;
+    char       cmd[64];
+    int        cmdlen = 0, cmdpoint;
+    LineReader reader;
+    int        retval = 0;
+
+    serial.setDirect();
+    serial.write('\f');  // Turn off echoing
+    while (more || count) {
+        // Keep the controller's input buffer as full as it will take
+        while (more) {
+            if (!cmdlen) {
+                cmdlen = probeCommand(grid, step, cmd, sizeof(cmd), cmdpoint);
+                if (!cmdlen) {
+                    more = false;
+                    break;
+                }
+            }
+            if (count == MAX_PENDING || inflight + cmdlen > RX_BUFFER_SIZE) {
+                break;
+            }
+            serial.write(cmd, cmdlen);
+            pending[(head + count++) % MAX_PENDING] = { cmdlen, cmdpoint };
+            inflight += cmdlen;
+            cmdlen = 0;
+            ++step;
+        }
+
+        // A probe can take a while at slow feed rates
+        int len = reader.read(serial, 60000);
+        if (len < 0) {
+            std::cout << "Timeout waiting for the controller" << std::endl;
+            retval = -2;
+            break;
+        }
+        const char* line = reader.line();
+        double      z;
+        bool        success;
+        if (parsePrb(line, z, success)) {
+            // The report precedes the ok for its G38.2, which is the oldest probe pending
+            int point = -1;
+            for (int i = 0; i < count && point < 0; ++i) {
+                point = pending[(head + i) % MAX_PENDING].point;
+            }
+            if (!success || point < 0) {
+                std::cout << "Probe failed: " << line << std::endl;
+                retval = -3;
+                break;
+            }
+            int ix, iy;
+            gridPoint(grid, point, ix, iy);
+            if (probed++ == 0) {
+                z0 = z;
+            }
+            map.set(ix, iy, z - z0);
+            std::cout << "Probed " << probed << "/" << npoints << " " << ix << "," << iy << " Z" << z - z0 << std::endl;
+            for (int i = 0; i < count; ++i) {
+                auto& p = pending[(head + i) % MAX_PENDING];
+                if (p.point == point) {
+                    p.point = -1;
+                    break;
+                }
+            }
+        } else if (!strncmp(line, "ok", 2)) {
+            if (count) {
+                inflight -= pending[head].len;
+                head = (head + 1) % MAX_PENDING;
+                --count;
+            }
+        } else if (!strncmp(line, "error", 5) || !strncmp(line, "ALARM", 5)) {
+            std::cout << line << std::endl;
+            retval = -1;
+            break;
+        } else if (len) {
+            std::cout << line << std::endl;
+        }
+    }
+    if (retval == 0 && probed != npoints) {
+        retval = -3;
+    }
+    if (retval < 0 && count) {
+        // Do not let the moves still queued in the controller run
+        serial.write('\x18');
+    }
+    serial.setIndirect();
+    serial.write('\t');  // Echo mode on
+    return retval;
+}
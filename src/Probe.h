@@ -0,0 +1,20 @@
+#pragma once
+
+#include "SerialPort.h"
+#include "HeightMap.h"
+
+struct ProbeGrid {
+    double x0, y0;     // first corner, work coordinates
+    double x1, y1;     // opposite corner
+    int    nx, ny;     // points along X and Y, at least 2 each
+    double depth;      // Z target for G38.2, below the lowest expected surface
+    double clearance;  // Z for travel between points
+    double feed;       // probing feed rate
+};
+
+// Probes every grid point and fills `map` with heights relative to the
+// first point.  Probe, retract and travel commands are streamed ahead
+// of the controller's replies, so the machine never waits on the host.
+// The corners may be given in either order, but must differ in X and Y.
+// Returns 0 on success, negative on a bad grid, error, alarm or a failed probe.
+int probeGrid(SerialPort& serial, const ProbeGrid& corners, HeightMap& map);
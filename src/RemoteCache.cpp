@@ -0,0 +1,98 @@
+#include "RemoteCache.h"
+#include <cstring>
+#include <set>
+
+constexpr std::chrono::seconds RemoteFileCache::MAX_AGE;
+
+static const char* rootOf(const std::string& remotePath, std::string& relative) {
+    return strcmp(remoteDevice(remotePath, relative), "SD") ? "/localfs/" : "/sd/";
+}
+
+RemoteFileCache::Root* RemoteFileCache::root(SerialPort& serial, const std::string& remotePath, std::string& relative) {
+    const char* name = rootOf(remotePath, relative);
+    Root&       r    = m_roots[name];
+    auto        now  = std::chrono::steady_clock::now();
+    if (!r.loaded || now - r.listed > MAX_AGE) {
+        std::vector<RemoteFile> files;
+        if (!listRemoteTree(serial, name, files)) {
+            m_roots.erase(name);
+            return nullptr;
+        }
+        r.files.clear();
+        for (auto& file : files) {
+            r.files[file.name] = file.size;
+        }
+        r.loaded = true;
+        r.listed = now;
+    }
+    return &r;
+}
+
+bool RemoteFileCache::list(SerialPort& serial, const std::string& dir, std::vector<RemoteFile>& files) {
+    std::string relative;
+    Root*       r = root(serial, dir, relative);
+    if (!r) {
+        return false;
+    }
+    if (relative.length() && relative.back() != '/') {
+        relative += '/';
+    }
+    for (auto it = r->files.lower_bound(relative); it != r->files.end() && it->first.compare(0, relative.length(), relative) == 0;
+         ++it) {
+        files.push_back({ it->first.substr(relative.length()), it->second });
+    }
+    return true;
+}
+
+std::vector<std::string> RemoteFileCache::complete(SerialPort& serial, const std::string& partial) {
+    std::vector<std::string> matches;
+
+    // Part of a filesystem name
+    if (partial.length() && partial[0] == '/') {
+        for (const char* name : { "/localfs/", "/sd/" }) {
+            if (partial.length() < strlen(name) && strncmp(name, partial.c_str(), partial.length()) == 0) {
+                matches.push_back(name);
+            }
+        }
+        if (matches.size()) {
+            return matches;
+        }
+    }
+
+    // What was typed before the path within the filesystem is kept
+    std::string relative;
+    Root*       r = root(serial, partial, relative);
+    if (!r) {
+        return matches;
+    }
+    std::string           typed = partial.substr(0, partial.length() - relative.length());
+    std::set<std::string> names;
+    for (auto it = r->files.lower_bound(relative); it != r->files.end() && it->first.compare(0, relative.length(), relative) == 0;
+         ++it) {
+        auto slash = it->first.find('/', relative.length());
+        names.insert(typed + it->first.substr(0, slash == std::string::npos ? slash : slash + 1));
+    }
+    matches.assign(names.begin(), names.end());
+    return matches;
+}
+
+void RemoteFileCache::added(const std::string& remotePath, int64_t size) {
+    std::string relative;
+    auto        it = m_roots.find(rootOf(remotePath, relative));
+    if (it != m_roots.end()) {
+        it->second.files[relative] = size;
+    }
+}
+
+void RemoteFileCache::removed(const std::string& remotePath) {
+    std::string relative;
+    auto        it = m_roots.find(rootOf(remotePath, relative));
+    if (it != m_roots.end()) {
+        it->second.files.erase(relative);
+    }
+}
+
+RemoteFileCache& remoteFileCache() {
+    static RemoteFileCache cache;
+    return cache;
+}
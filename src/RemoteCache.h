@@ -0,0 +1,46 @@
+#pragma once
+
+#include "RemoteFiles.h"
+#include "SerialPort.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// An in-memory copy of the controller's file listings.  Each filesystem
+// is listed the first time it is asked about and again once the copy is
+// MAX_AGE old, so changes made from elsewhere show up eventually.
+// FluidTerm's own uploads and deletes are applied as they happen, so
+// they never force another listing.
+class RemoteFileCache {
+private:
+    struct Root {
+        bool                                  loaded = false;
+        std::chrono::steady_clock::time_point listed;
+        std::map<std::string, int64_t>        files;  // size by path within the filesystem
+    };
+
+    std::map<std::string, Root> m_roots;  // by "/localfs/" or "/sd/"
+
+    Root* root(SerialPort& serial, const std::string& remotePath, std::string& relative);
+
+public:
+    static constexpr std::chrono::seconds MAX_AGE { 300 };
+
+    // The files under a remote directory and its subdirectories, named
+    // by their paths within it
+    bool list(SerialPort& serial, const std::string& dir, std::vector<RemoteFile>& files);
+
+    // The ways a partly typed remote path can go on: file names, and
+    // directory names ending in '/', one level at a time
+    std::vector<std::string> complete(SerialPort& serial, const std::string& partial);
+
+    void added(const std::string& remotePath, int64_t size);
+    void removed(const std::string& remotePath);
+
+    // Lists everything again when next asked
+    void invalidate() { m_roots.clear(); }
+};
+
+RemoteFileCache& remoteFileCache();
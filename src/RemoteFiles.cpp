@@ -0,0 +1,197 @@
+#include "RemoteFiles.h"
+#include "LineReader.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+int remoteCommand(SerialPort& serial, const std::string& command, std::vector<std::string>& reply, uint32_t ms) {
+    int retval = -2;
+    serial.setDirect();
+    serial.write('\f');  // Turn off echoing
+    serial.write(command);
+    serial.write('\n');
+
+    LineReader reader;
+    int        len;
+    while ((len = reader.read(serial, ms)) >= 0) {
+        if (reader.startsWith("ok")) {
+            retval = 0;
+            break;
+        }
+        if (reader.startsWith("error")) {
+            reply.emplace_back(reader.line(), len);
+            retval = -1;
+            break;
+        }
+        if (len && command.compare(reader.line()) != 0) {
+            reply.emplace_back(reader.line(), len);
+        }
+    }
+    serial.setIndirect();
+    serial.write('\t');  // Echo mode on
+    return retval;
+}
+
+const char* remoteDevice(const std::string& remotePath, std::string& relative) {
+    if (!remotePath.compare(0, 4, "/sd/")) {
+        relative = remotePath.substr(4);
+        return "SD";
+    }
+    if (!remotePath.compare(0, 9, "/localfs/")) {
+        relative = remotePath.substr(9);
+    } else {
+        relative = remotePath[0] == '/' ? remotePath.substr(1) : remotePath;
+    }
+    return "LocalFS";
+}
+
+// Parses "[FILE: name|SIZE:1234]"
+static bool parseFileLine(const std::string& line, RemoteFile& file) {
+    if (line.compare(0, 6, "[FILE:") != 0) {
+        return false;
+    }
+    auto bar = line.find("|SIZE:");
+    if (bar == std::string::npos) {
+        return false;
+    }
+    size_t start = 6;
+    while (start < bar && line[start] == ' ') {
+        ++start;
+    }
+    file.name = line.substr(start, bar - start);
+    auto slash = file.name.rfind('/');
+    if (slash != std::string::npos) {
+        file.name.erase(0, slash + 1);
+    }
+    file.size = strtoll(line.c_str() + bar + 6, nullptr, 10);
+    return true;
+}
+
+// The spaces before the name after a "[FILE:" or "[DIR:" tag, which is
+// how a recursive listing shows the depth.  A file's tag is followed by
+// one space of its own.
+static size_t indentation(const std::string& line, size_t tagLength, bool isFile) {
+    size_t n = 0;
+    while (tagLength + n < line.length() && line[tagLength + n] == ' ') {
+        ++n;
+    }
+    return isFile && n ? n - 1 : n;
+}
+
+bool listRemoteFiles(SerialPort& serial, const std::string& dir, std::vector<RemoteFile>& files) {
+    std::string relative;
+    const char* device  = remoteDevice(dir, relative);
+    std::string command = std::string("$") + device + "/List";
+    if (relative.length()) {
+        command += "=" + relative;
+    }
+    std::vector<std::string> reply;
+    if (remoteCommand(serial, command, reply) < 0) {
+        return false;
+    }
+    // Newer firmware lists subdirectories too, indented; only the files
+    // in `dir` itself are wanted, not same-named ones further down
+    for (auto& line : reply) {
+        RemoteFile file;
+        if (parseFileLine(line, file) && indentation(line, 6, true) == 0) {
+            files.push_back(file);
+        }
+    }
+    return true;
+}
+
+bool listRemoteTree(SerialPort& serial, const std::string& dir, std::vector<RemoteFile>& files) {
+    std::string relative;
+    const char* device  = remoteDevice(dir, relative);
+    std::string command = std::string("$") + device + "/List";
+    if (relative.length()) {
+        command += "=" + relative;
+    }
+    std::vector<std::string> reply;
+    if (remoteCommand(serial, command, reply) < 0) {
+        return false;
+    }
+
+    std::vector<std::pair<std::string, bool>> dirs;     // path, whether the listing showed anything in it
+    std::vector<std::pair<size_t, size_t>>    parents;  // depth and index in dirs of the enclosing directories
+    for (auto& line : reply) {
+        RemoteFile file;
+        bool       isFile = parseFileLine(line, file);
+        if (!isFile && line.compare(0, 5, "[DIR:") != 0) {
+            continue;
+        }
+        size_t depth = indentation(line, isFile ? 6 : 5, isFile);
+        while (parents.size() && parents.back().first >= depth) {
+            parents.pop_back();
+        }
+        std::string path;
+        if (parents.size()) {
+            dirs[parents.back().second].second = true;
+            path                               = dirs[parents.back().second].first + "/";
+        }
+        if (isFile) {
+            file.name = path + file.name;
+            files.push_back(file);
+        } else {
+            size_t start = line.find_first_not_of(' ', 5);
+            if (start == std::string::npos) {
+                continue;
+            }
+            parents.push_back({ depth, dirs.size() });
+            dirs.push_back({ path + line.substr(start, line.find(']') - start), false });
+        }
+    }
+
+    // Older firmware lists one level only, so the directories it showed
+    // nothing in are listed on their own
+    std::string base = dir.length() && dir.back() != '/' ? dir + "/" : dir;
+    for (auto& d : dirs) {
+        if (!d.second) {
+            std::vector<RemoteFile> inner;
+            if (!listRemoteTree(serial, base + d.first + "/", inner)) {
+                return false;
+            }
+            for (auto& file : inner) {
+                file.name = d.first + "/" + file.name;
+                files.push_back(file);
+            }
+        }
+    }
+    return true;
+}
+
+// Finds 64 hex digits in a row, the form a SHA-256 is printed in
+static bool findSha256(const std::string& line, std::string& hex) {
+    size_t run = 0;
+    for (size_t i = 0; i < line.length(); ++i) {
+        run = isxdigit((unsigned char)line[i]) ? run + 1 : 0;
+        bool end = i + 1 == line.length() || !isxdigit((unsigned char)line[i + 1]);
+        if (run == 64 && end) {
+            hex = line.substr(i - 63, 64);
+            for (char& c : hex) {
+                c = char(tolower((unsigned char)c));
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+int remoteFileHash(SerialPort& serial, const std::string& remotePath, std::string& hex) {
+    std::string relative;
+    const char* device = remoteDevice(remotePath, relative);
+    std::string path   = std::string(strcmp(device, "SD") ? "/localfs/" : "/sd/") + relative;
+
+    std::vector<std::string> reply;
+    int                      ret = remoteCommand(serial, "$File/ShowHash=" + path, reply);
+    if (ret < 0) {
+        // error:3 is an unknown $ command; other errors are about the file
+        return ret == -1 && reply.size() && reply.back().compare(0, 7, "error:3") == 0 && reply.back().length() == 7 ? -1 : -2;
+    }
+    for (auto& line : reply) {
+        if (findSha256(line, hex)) {
+            return 0;
+        }
+    }
+    return -2;
+}
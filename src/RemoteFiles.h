@@ -0,0 +1,32 @@
+#pragma once
+
+#include "SerialPort.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RemoteFile {
+    std::string name;
+    int64_t     size;
+};
+
+// Sends a FluidNC $ command and collects the reply lines up to the
+// final "ok".  Returns 0 on ok, -1 on an error reply, -2 on timeout.
+int remoteCommand(SerialPort& serial, const std::string& command, std::vector<std::string>& reply, uint32_t ms = 2000);
+
+// Which FluidNC filesystem a remote path lives on: "SD" for /sd/...,
+// otherwise "LocalFS".  `relative` is the path within that filesystem.
+const char* remoteDevice(const std::string& remotePath, std::string& relative);
+
+// Lists the files in a remote directory, e.g. "/sd/" or "/localfs/jobs",
+// leaving out those in its subdirectories
+bool listRemoteFiles(SerialPort& serial, const std::string& dir, std::vector<RemoteFile>& files);
+
+// Lists every file under a remote directory and its subdirectories,
+// named by their paths within it, e.g. "jobs/part.nc"
+bool listRemoteTree(SerialPort& serial, const std::string& dir, std::vector<RemoteFile>& files);
+
+// Asks FluidNC for the SHA-256 of a file, as lowercase hex.  Returns 0
+// on success, -1 if the command is unknown (older FluidNC versions do
+// not have it) or -2 if there is no hash for the file.
+int remoteFileHash(SerialPort& serial, const std::string& remotePath, std::string& hex);
@@ -0,0 +1,118 @@
+#include "RunRemote.h"
+#include "Colorize.h"
+#include "Console.h"
+#include "FileSystem.h"
+#include "LineReader.h"
+#include "RemoteFiles.h"
+#include "StatusReport.h"
+#include "Upload.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+int runRemote(SerialPort& serial, const std::string& path, const std::string& remoteName, uint32_t pollMs) {
+    int64_t size = fileSize(path.c_str());
+    if (size < 0) {
+        std::cout << "Can't open " << path << std::endl;
+        return -1;
+    }
+
+    std::string             dir  = remoteName.substr(0, remoteName.rfind('/') + 1);
+    std::string             tail = remoteName.substr(dir.length());
+    std::vector<RemoteFile> files;
+    bool                    present = false;
+    if (listRemoteFiles(serial, dir.length() ? dir : "/localfs/", files)) {
+        for (auto& f : files) {
+            present = present || (f.name == tail && f.size == size);
+        }
+    }
+    if (present) {
+        std::cout << remoteName << " is already on the controller, skipping upload" << std::endl;
+    } else if (uploadFile(serial, path, remoteName) < 0) {
+        return -1;
+    }
+
+    std::string              relative;
+    std::string              device = remoteDevice(remoteName, relative);
+    std::vector<std::string> reply;
+    if (remoteCommand(serial, "$" + device + "/Run=" + relative, reply) < 0) {
+        for (auto& line : reply) {
+            std::cout << line << std::endl;
+        }
+        return -1;
+    }
+    return monitorRemote(serial, pollMs);
+}
+
+int monitorRemote(SerialPort& serial, uint32_t pollMs) {
+    using clock = std::chrono::steady_clock;
+
+    auto         start    = clock::now();
+    auto         nextPoll = start;
+    bool         seenJob  = false;
+    int          retval   = 0;
+    LineReader   reader;
+    StatusReport report;
+
+    std::cout << "Monitoring - press any key to detach" << std::endl;
+    serial.setDirect();
+    serial.write('\f');  // Turn off echoing
+    while (true) {
+        if (availConsoleChar()) {
+            getConsoleChar();
+            std::cout << std::endl << "Detached; the job continues on the controller" << std::endl;
+            break;
+        }
+        auto now = clock::now();
+        if (now >= nextPoll) {
+            serial.write('?');
+            nextPoll = now + std::chrono::milliseconds(pollMs);
+        }
+
+        int len = reader.read(serial, 50);
+        if (len <= 0) {
+            continue;
+        }
+        if (!parseStatusReport(reader.line(), len, report)) {
+            // Messages go on their own line above the status line
+            std::cout << "\r\x1b[K" << reader.line() << std::endl;
+            continue;
+        }
+
+        if (!strncmp(report.state, "Alarm", 5)) {
+            errorColor();
+            std::cout << "\r\x1b[K" << "Controller is in alarm state" << std::endl;
+            normalColor();
+            retval = -1;
+            break;
+        }
+        if (!report.hasSd) {
+            if (!strcmp(report.state, "Idle")) {
+                goodColor();
+                std::cout << "\r\x1b[K" << (seenJob ? "Job finished" : "No job is running") << std::endl;
+                normalColor();
+                break;
+            }
+            continue;
+        }
+        seenJob = true;
+
+        long secs = long(std::chrono::duration_cast<std::chrono::seconds>(now - start).count());
+        char status[160];
+        snprintf(status,
+                 sizeof(status),
+                 "%-8s %5.1f%%  %02ld:%02ld:%02ld  %s",
+                 report.state,
+                 report.sdPercent,
+                 secs / 3600,
+                 secs / 60 % 60,
+                 secs % 60,
+                 report.sdFile);
+        infoColor();
+        std::cout << "\r\x1b[K" << status << std::flush;
+        normalColor();
+    }
+    serial.setIndirect();
+    serial.write('\t');  // Echo mode on
+    return retval;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "SerialPort.h"
+#include <string>
+
+// Uploads a job unless a file of the same name and size is already on
+// the controller, starts it with $SD/Run (or $LocalFS/Run), then
+// monitors it.  Returns 0 when the job finishes or the user detaches.
+int runRemote(SerialPort& serial, const std::string& path, const std::string& remoteName, uint32_t pollMs);
+
+// Polls status at `pollMs` and shows the progress of a job running
+// from the controller's filesystem on one status line.  Any key
+// detaches, leaving the job running.
+int monitorRemote(SerialPort& serial, uint32_t pollMs);
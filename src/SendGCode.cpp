@@ -1,35 +1,83 @@
 #include "SendGCode.h"
+#include "AllocCount.h"
+#include "LineReader.h"
+#include "Pipeline.h"
 #include <iostream>
-#include <fstream>
-#include <thread>
 
-int sendGCode(SerialPort& serial, std::ifstream& infile) {
+// Sends one line and waits for the response line.  Status reports
+// that arrive meanwhile go to the monitor, which also gets to poll.
+// Returns -1 if the response is an error.
+static int sendLine(SerialPort& serial, const char* line, size_t len, LineReader& reader, StarvationMonitor* monitor) {
+    std::cout << "> ";
+    std::cout.write(line, len);
+    std::cout << std::endl;
+    if (monitor) {
+        monitor->poll(serial);
+    }
+    serial.write(line, len);
+    serial.write('\n');
+    while (true) {
+        if (monitor) {
+            monitor->poll(serial);
+        }
+        int n = reader.read(serial, monitor ? 20 : 4000);
+        if (n == -1) {
+            continue;
+        }
+        if (monitor && monitor->statusLine(reader.line(), n)) {
+            continue;
+        }
+        std::cout.write(reader.line(), n);
+        std::cout << std::endl;
+        return reader.startsWith("error") ? -1 : 0;
+    }
+}
+
+int sendGCode(SerialPort& serial, std::istream& infile, GCodeTransform* transform, StarvationMonitor* monitor) {
     int retval = 0;
     serial.setDirect();
     serial.write('\f');  // Turn off echoing
-    for (std::string line; std::getline(infile, line);) {
-        std::cout << "> " << line << std::endl;
-        serial.write(line);
-        serial.write('\n');
-        char  sline[128];
-        char* sp = sline;
-        do {
-            int c = serial.timedRead(4000);
-            if (c == -1) {
-                continue;
-            }
-            *sp++ = c;
-            std::cout << char(c);
-            if (char(c) == '\n') {
-                if (!strncmp(sline, "error", strlen("error"))) {
-                    retval = -1;
-                    goto out;
-                }
-                break;
-            }
-        } while (true);
+
+    // Reading and transforming run on their own threads, ahead of
+    // the port, so the wait for each "ok" is the only wait
+    Pipeline pipeline(infile);
+    if (transform) {
+        pipeline.add(transform);
+    }
+    pipeline.start();
+
+    LineReader  responses;
+    const char* line;
+    size_t      len;
+    size_t      sourceLine;
+#ifdef COUNT_ALLOCATIONS
+    const size_t warmup   = 100;
+    size_t       lines    = 0;
+    size_t       baseline = 0;
+#endif
+    while (pipeline.next(line, len, sourceLine)) {
+        if (monitor) {
+            monitor->setLine(sourceLine);
+        }
+#ifdef COUNT_ALLOCATIONS
+        if (++lines == warmup) {
+            baseline = allocationCount();
+        }
+#endif
+        if (sendLine(serial, line, len, responses, monitor) < 0) {
+            retval = -1;
+            break;
+        }
+    }
+    if (pipeline.bad()) {
+        std::cout << "Error reading the G-code file" << std::endl;
+        retval = -1;
+    }
+#ifdef COUNT_ALLOCATIONS
+    if (lines > warmup) {
+        std::cout << allocationCount() - baseline << " heap allocations in " << lines - warmup << " lines after warm-up" << std::endl;
     }
-out:
+#endif
     serial.setIndirect();
     serial.write('\t');  // Echo mode on
     return retval;
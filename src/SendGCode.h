@@ -1,6 +1,10 @@
 #pragma once
 
 #include "SerialPort.h"
-#include <fstream>
+#include "GCode.h"
+#include "Starvation.h"
+#include <istream>
 
-int sendGCode(SerialPort& serial, std::ifstream& in);
+// Streams the job line by line, waiting for each response.  With a
+// monitor, status reports are polled during the job.
+int sendGCode(SerialPort& serial, std::istream& in, GCodeTransform* transform = nullptr, StarvationMonitor* monitor = nullptr);
@@ -0,0 +1,184 @@
+#include "Sha256.h"
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#    define HAVE_SHA_NI
+#    include <cpuid.h>
+#    include <immintrin.h>
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be,
+    0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa,
+    0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+    0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+    0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static void compressPortable(uint32_t* state, const uint8_t* p, size_t blocks) {
+    for (; blocks--; p += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = uint32_t(p[4 * i]) << 24 | uint32_t(p[4 * i + 1]) << 16 | uint32_t(p[4 * i + 2]) << 8 | p[4 * i + 3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i]        = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h           = g;
+            g           = f;
+            f           = e;
+            e           = d + t1;
+            d           = c;
+            c           = b;
+            b           = a;
+            a           = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef HAVE_SHA_NI
+// The SHA-NI rounds work on the state as ABEF and CDGH halves and take
+// the message schedule four words at a time
+__attribute__((target("sha,sse4.1"))) static void compressShaNi(uint32_t* state, const uint8_t* p, size_t blocks) {
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp            = _mm_shuffle_epi32(tmp, 0xB1);        // CDAB
+    state1         = _mm_shuffle_epi32(state1, 0x1B);     // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);     // ABEF
+    state1         = _mm_blend_epi16(state1, tmp, 0xF0);  // CDGH
+
+    for (; blocks--; p += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i w[4];
+        for (int i = 0; i < 16; ++i) {
+            __m128i m;
+            if (i < 4) {
+                m = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i)), MASK);
+            } else {
+                m = _mm_sha256msg1_epu32(w[i & 3], w[(i - 3) & 3]);
+                m = _mm_add_epi32(m, _mm_alignr_epi8(w[(i - 1) & 3], w[(i - 2) & 3], 4));
+                m = _mm_sha256msg2_epu32(m, w[(i - 1) & 3]);
+            }
+            w[i & 3]  = m;
+            __m128i k = _mm_add_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[4 * i])));
+            state1    = _mm_sha256rnds2_epu32(state1, state0, k);
+            state0    = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(k, 0x0E));
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);     // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);     // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+static bool cpuHasShaNi() {
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_1) || !(c & bit_SSSE3)) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29));
+}
+#endif
+
+using Compress = void (*)(uint32_t*, const uint8_t*, size_t);
+
+static Compress compressor() {
+#ifdef HAVE_SHA_NI
+    static const Compress chosen = cpuHasShaNi() ? compressShaNi : compressPortable;
+    return chosen;
+#else
+    return compressPortable;
+#endif
+}
+
+bool Sha256::accelerated() {
+    return compressor() != compressPortable;
+}
+
+Sha256::Sha256() : m_total(0), m_buflen(0) {
+    static const uint32_t init[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(m_state, init, sizeof(m_state));
+}
+
+void Sha256::update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_total += len;
+    if (m_buflen) {
+        size_t fill = 64 - m_buflen < len ? 64 - m_buflen : len;
+        memcpy(m_buf + m_buflen, p, fill);
+        m_buflen += fill;
+        p += fill;
+        len -= fill;
+        if (m_buflen < 64) {
+            return;
+        }
+        compressor()(m_state, m_buf, 1);
+        m_buflen = 0;
+    }
+    compressor()(m_state, p, len / 64);
+    p += len & ~size_t(63);
+    len &= 63;
+    memcpy(m_buf, p, len);
+    m_buflen = len;
+}
+
+std::string Sha256::hex() {
+    uint64_t bits = m_total * 8;
+    uint8_t  pad[72];
+    size_t   padlen = (m_buflen < 56 ? 56 : 120) - m_buflen;
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (int i = 0; i < 8; ++i) {
+        pad[padlen + i] = uint8_t(bits >> (56 - 8 * i));
+    }
+    update(pad, padlen + 8);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string       out;
+    for (uint32_t word : m_state) {
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            out += digits[(word >> shift) & 15];
+        }
+    }
+    return out;
+}
+
+std::string sha256Stream(std::istream& in) {
+    Sha256            hash;
+    std::vector<char> buf(1 << 20);
+    while (in.read(buf.data(), buf.size()) || in.gcount()) {
+        hash.update(buf.data(), size_t(in.gcount()));
+    }
+    in.clear();
+    in.seekg(0);
+    return hash.hex();
+}
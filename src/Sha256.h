@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+
+// Streaming SHA-256, the hash FluidNC keeps for its files.  Blocks are
+// compressed with the SHA-NI instructions where the CPU has them.
+class Sha256 {
+private:
+    uint32_t m_state[8];
+    uint64_t m_total;
+    uint8_t  m_buf[64];
+    size_t   m_buflen;
+
+public:
+    Sha256();
+
+    void update(const void* data, size_t len);
+
+    // Lowercase hex of the digest
+    std::string hex();
+
+    // True if the hardware SHA-256 path is in use
+    static bool accelerated();
+};
+
+// Hashes everything left in the stream, then rewinds it to the start
+std::string sha256Stream(std::istream& in);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// A bounded lock-free queue for exactly one producer thread and one
+// consumer thread.  N must be a power of two.
+template <typename T, size_t N>
+class SpscQueue {
+private:
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+    T                                m_items[N];
+    alignas(64) std::atomic<size_t> m_head { 0 };  // next to pop
+    alignas(64) std::atomic<size_t> m_tail { 0 };  // next to push
+
+public:
+    // Returns false if the queue is full
+    bool push(const T& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        m_items[tail & (N - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = m_items[head & (N - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
@@ -0,0 +1,84 @@
+#include "Starvation.h"
+#include <cstdio>
+#include <cstring>
+
+void StarvationMonitor::start() {
+    m_start    = clock::now();
+    m_nextPoll = m_start;
+    m_line     = 0;
+    m_reports  = 0;
+    m_capacity = 0;
+    m_moving   = false;
+    m_starved  = false;
+    m_feed     = 0;
+    m_underruns.clear();
+}
+
+void StarvationMonitor::poll(SerialPort& serial) {
+    auto now = clock::now();
+    if (now >= m_nextPoll) {
+        serial.write('?');
+        m_nextPoll = now + std::chrono::milliseconds(m_pollMs);
+    }
+}
+
+bool StarvationMonitor::statusLine(const char* line, size_t len) {
+    if (!parseStatusReport(line, len, m_status)) {
+        return false;
+    }
+    ++m_reports;
+    double t = std::chrono::duration<double>(clock::now() - m_start).count();
+    if (m_status.hasBf && m_status.bfBlocks > m_capacity) {
+        m_capacity = m_status.bfBlocks;
+    }
+
+    bool running = !strcmp(m_status.state, "Run");
+    bool idle    = !strcmp(m_status.state, "Idle");
+    if (running) {
+        m_moving = true;
+    }
+    if (running && m_status.hasFs && m_status.feed > 0) {
+        m_feed = m_status.feed;
+    }
+    bool starved = m_moving && (idle || (running && m_status.hasBf && m_status.bfBlocks == m_capacity));
+    if (starved) {
+        if (!m_starved && m_underruns.size() < m_underruns.capacity()) {
+            m_underruns.push_back({ t, t, m_line, m_feed });
+        } else if (m_underruns.size()) {
+            m_underruns.back().end = t;
+        }
+    }
+    m_starved = starved;
+    return true;
+}
+
+void StarvationMonitor::report(std::ostream& out) const {
+    if (m_reports == 0) {
+        out << "No status reports were received; planner starvation is unknown" << std::endl;
+        return;
+    }
+    if (m_underruns.empty()) {
+        out << "The planner never ran dry (" << m_reports << " status reports, every " << m_pollMs << " ms)" << std::endl;
+        return;
+    }
+    // An underrun seen in one report lasted up to one poll interval
+    double interval = m_pollMs / 1000.0;
+    double total    = 0;
+    for (const Underrun& u : m_underruns) {
+        total += u.end - u.start + interval;
+    }
+    out << m_underruns.size() << " planner underruns, about " << total << " s starved (" << m_reports << " status reports, every "
+        << m_pollMs << " ms)" << std::endl;
+    for (const Underrun& u : m_underruns) {
+        char text[100];
+        snprintf(text,
+                 sizeof(text),
+                 "  %02d:%04.1f  line %-7lu %5.1f s  F%g",
+                 int(u.start) / 60,
+                 u.start - int(u.start) / 60 * 60,
+                 (unsigned long)u.line,
+                 u.end - u.start + interval,
+                 u.feed);
+        out << text << std::endl;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "SerialPort.h"
+#include "StatusReport.h"
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// A stretch of consecutive status reports showing the planner empty
+struct Underrun {
+    double start, end;  // s since the job started
+    size_t line;        // line being sent when it began
+    double feed;        // last feed rate reported while running
+};
+
+// Watches status reports while a job streams and records each time the
+// planner runs dry: the machine goes Idle after it started moving, or
+// reports Run with every planner block free.  The capacity is taken
+// from the largest Bf: block count seen; the first poll goes out before
+// the first line does.
+class StarvationMonitor {
+private:
+    using clock = std::chrono::steady_clock;
+
+    uint32_t              m_pollMs;
+    clock::time_point     m_start;
+    clock::time_point     m_nextPoll;
+    size_t                m_line;
+    size_t                m_reports;
+    int                   m_capacity;
+    bool                  m_moving;
+    bool                  m_starved;
+    double                m_feed;
+    StatusReport          m_status;
+    std::vector<Underrun> m_underruns;
+
+public:
+    explicit StarvationMonitor(uint32_t pollMs) : m_pollMs(pollMs) { m_underruns.reserve(256); }
+
+    void start();
+
+    // The line now being sent, for attributing underruns
+    void setLine(size_t line) { m_line = line; }
+
+    // Sends a status request if one is due
+    void poll(SerialPort& serial);
+
+    // Returns false if the line is not a status report
+    bool statusLine(const char* line, size_t len);
+
+    void report(std::ostream& out) const;
+};
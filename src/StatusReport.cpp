@@ -0,0 +1,61 @@
+#include "StatusReport.h"
+#include <cstdlib>
+#include <cstring>
+
+// Copies [begin, end) into a fixed buffer, truncating if needed
+static void copyField(char* dest, size_t size, const char* begin, const char* end) {
+    size_t n = end - begin;
+    if (n >= size) {
+        n = size - 1;
+    }
+    memcpy(dest, begin, n);
+    dest[n] = '\0';
+}
+
+bool parseStatusReport(const char* line, size_t len, StatusReport& report) {
+    if (len < 2 || line[0] != '<' || line[len - 1] != '>') {
+        return false;
+    }
+    const char* end   = line + len - 1;
+    const char* field = line + 1;
+
+    report.hasSd     = false;
+    report.sdPercent = 0;
+    report.sdFile[0] = '\0';
+    report.hasBf     = false;
+    report.hasFs     = false;
+
+    bool first = true;
+    while (field <= end) {
+        const char* bar = static_cast<const char*>(memchr(field, '|', end - field));
+        if (!bar) {
+            bar = end;
+        }
+        if (first) {
+            copyField(report.state, sizeof(report.state), field, bar);
+            first = false;
+        } else if (bar - field > 3 && !strncmp(field, "SD:", 3)) {
+            // SD:percent,filename
+            report.hasSd        = true;
+            report.sdPercent    = strtod(field + 3, nullptr);
+            const char* comma   = static_cast<const char*>(memchr(field, ',', bar - field));
+            if (comma) {
+                copyField(report.sdFile, sizeof(report.sdFile), comma + 1, bar);
+            }
+        } else if (bar - field > 3 && !strncmp(field, "Bf:", 3)) {
+            // Bf:blocks,bytes
+            char* next      = nullptr;
+            report.hasBf    = true;
+            report.bfBlocks = int(strtol(field + 3, &next, 10));
+            report.bfBytes  = *next == ',' ? int(strtol(next + 1, nullptr, 10)) : 0;
+        } else if (bar - field > 2 && (!strncmp(field, "FS:", 3) || !strncmp(field, "F:", 2))) {
+            // FS:feed,spindle or F:feed
+            char* next     = nullptr;
+            report.hasFs   = true;
+            report.feed    = strtod(field + (field[1] == 'S' ? 3 : 2), &next);
+            report.spindle = *next == ',' ? strtod(next + 1, nullptr) : 0;
+        }
+        field = bar + 1;
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+// The fields of a FluidNC "<State|...>" status report that FluidTerm
+// uses.  Parsing is done in place without allocating.
+struct StatusReport {
+    char   state[16];  // Idle, Run, Hold:0, Alarm, ...
+    bool   hasSd;
+    double sdPercent;
+    char   sdFile[96];
+    bool   hasBf;
+    int    bfBlocks;  // free planner blocks
+    int    bfBytes;   // free serial receive buffer bytes
+    bool   hasFs;
+    double feed;      // current feed rate
+    double spindle;   // current spindle speed
+};
+
+// Returns false if the line is not a status report
+bool parseStatusReport(const char* line, size_t len, StatusReport& report);
@@ -0,0 +1,176 @@
+#include "Sync.h"
+#include "FileSystem.h"
+#include "Hash.h"
+#include "RemoteCache.h"
+#include "RemoteFiles.h"
+#include "Upload.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+struct LocalFile {
+    std::string name;
+    int64_t     size;
+    uint64_t    hash;
+};
+
+// What was uploaded by the last sync, by file name
+struct SyncedFile {
+    int64_t  size;
+    uint64_t hash;
+};
+
+// Hashes the files on all cores
+static void hashFiles(const std::string& dir, std::vector<LocalFile>& files) {
+    std::atomic<size_t>      next { 0 };
+    std::vector<std::thread> threads;
+    size_t                   count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), files.size());
+    for (size_t t = 0; t < count; ++t) {
+        threads.emplace_back([&]() {
+            size_t i;
+            while ((i = next++) < files.size()) {
+                std::ifstream in(dir + "/" + files[i].name, std::ifstream::in | std::ifstream::binary);
+                files[i].hash = hashStream(in);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+// The state is kept per port, local directory and remote directory
+static std::string statePath(SerialPort& serial, const std::string& localDir, const std::string& remoteDir) {
+    std::string key = serial.m_portName + "\n" + localDir + "\n" + remoteDir;
+    Hash64      hash;
+    hash.update(key.c_str(), key.length());
+    char name[40];
+    snprintf(name, sizeof(name), "sync-%016llx.txt", (unsigned long long)hash.digest());
+    return cacheDirectory() + "/" + name;
+}
+
+static void loadState(const std::string& path, std::map<std::string, SyncedFile>& state) {
+    std::ifstream in(path);
+    std::string   line;
+    while (std::getline(in, line)) {
+        unsigned long long hash;
+        long long          size;
+        int                offset;
+        if (sscanf(line.c_str(), "%llx %lld %n", &hash, &size, &offset) == 2) {
+            state[line.substr(offset)] = { int64_t(size), uint64_t(hash) };
+        }
+    }
+}
+
+static void saveState(const std::string& path, const std::map<std::string, SyncedFile>& state) {
+    makeDirectories(cacheDirectory());
+    std::ofstream out(path);
+    for (auto& entry : state) {
+        char text[40];
+        snprintf(text, sizeof(text), "%016llx %lld ", (unsigned long long)entry.second.hash, (long long)entry.second.size);
+        out << text << entry.first << std::endl;
+    }
+}
+
+int syncDirectory(SerialPort& serial, const std::string& localDir, const std::string& remoteDir, bool deleteStale) {
+    std::string dir = remoteDir;
+    if (dir.length() && dir.back() != '/') {
+        dir += '/';
+    }
+
+    std::vector<FileInfo>  entries;
+    std::vector<LocalFile> local;
+    if (!listDirectory(localDir, entries)) {
+        std::cout << "Cannot read " << localDir << std::endl;
+        return -1;
+    }
+    for (auto& entry : entries) {
+        if (!entry.isDir) {
+            local.push_back({ entry.name, entry.size, 0 });
+        }
+    }
+
+    std::vector<RemoteFile> remote;
+    if (!listRemoteFiles(serial, dir, remote)) {
+        std::cout << "Cannot list " << dir << std::endl;
+        return -1;
+    }
+    std::map<std::string, int64_t> remoteSizes;
+    for (auto& file : remote) {
+        remoteSizes[file.name] = file.size;
+    }
+
+    hashFiles(localDir, local);
+    std::string                       stateFile = statePath(serial, localDir, dir);
+    std::map<std::string, SyncedFile> state;
+    loadState(stateFile, state);
+
+    std::vector<UploadItem> items;
+    std::vector<LocalFile*> changed;
+    int64_t                 totalBytes = 0;
+    int64_t                 sendBytes  = 0;
+    for (auto& file : local) {
+        totalBytes += file.size;
+        // A compressed upload is stored under another name and size
+        std::string stored = uploadedName(file.name);
+        auto        it     = remoteSizes.find(stored);
+        auto        last   = state.find(file.name);
+        if (it != remoteSizes.end() && (stored != file.name || it->second == file.size) && last != state.end()
+            && last->second.hash == file.hash && last->second.size == file.size) {
+            continue;
+        }
+        items.push_back({ localDir + "/" + file.name, dir + file.name });
+        changed.push_back(&file);
+        sendBytes += file.size;
+    }
+
+    int sent = 0;
+    if (items.size()) {
+        uploadFiles(serial, items);
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (items[i].done) {
+                state[changed[i]->name] = { changed[i]->size, changed[i]->hash };
+                ++sent;
+            }
+        }
+    }
+
+    int deleted = 0;
+    if (deleteStale) {
+        for (auto& file : remote) {
+            bool present = std::any_of(local.begin(), local.end(), [&](const LocalFile& l) { return uploadedName(l.name) == file.name; });
+            if (present) {
+                continue;
+            }
+            std::string              relative;
+            const char*              device = remoteDevice(dir + file.name, relative);
+            std::vector<std::string> reply;
+            if (remoteCommand(serial, std::string("$") + device + "/Delete=" + relative, reply) == 0) {
+                remoteFileCache().removed(dir + file.name);
+                ++deleted;
+            } else {
+                std::cout << "Cannot delete " << dir << file.name << std::endl;
+            }
+            state.erase(file.name);
+        }
+    }
+    saveState(stateFile, state);
+
+    int64_t saved = totalBytes - sendBytes;
+    std::cout << "Synced " << localDir << " to " << dir << ": " << sent << " of " << local.size() << " files uploaded";
+    if (deleteStale) {
+        std::cout << ", " << deleted << " deleted";
+    }
+    std::cout << std::endl;
+    std::cout << sendBytes << " of " << totalBytes << " bytes sent, saving " << saved << " bytes";
+    if (totalBytes) {
+        std::cout << " (" << 100 * saved / totalBytes << "%)";
+    }
+    std::cout << " against a full upload" << std::endl;
+    return sent < int(items.size()) ? -1 : sent;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "SerialPort.h"
+#include <string>
+
+// Makes a remote directory match a local one.  A file is uploaded if
+// the remote copy is missing or a different size, or if its contents
+// changed since the last sync to the same place; the changed files go
+// up in one batch.  With `deleteStale`, remote files that have no
+// local counterpart are deleted.  Returns the number of files
+// uploaded, or negative on error.
+int syncDirectory(SerialPort& serial, const std::string& localDir, const std::string& remoteDir, bool deleteStale);
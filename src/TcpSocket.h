@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A blocking TCP client connection, implemented in windows/ and mac/
+class TcpSocket {
+private:
+    intptr_t m_fd = -1;
+
+    friend class TcpListener;
+
+public:
+    TcpSocket() = default;
+    ~TcpSocket();
+    TcpSocket(const TcpSocket&)            = delete;
+    TcpSocket& operator=(const TcpSocket&) = delete;
+
+    // Returns false if the host cannot be reached within `ms`
+    bool connect(const std::string& host, uint16_t port, uint32_t ms);
+
+    // Sends all of `len` bytes.  Returns false on error, or if the peer
+    // stops taking data for `ms`.
+    bool send(const char* data, size_t len, uint32_t ms);
+
+    // Returns the number of bytes read, 0 if the peer closed the
+    // connection, or -1 on error or if nothing arrives within `ms`
+    int recv(char* buf, size_t len, uint32_t ms);
+
+    void close();
+};
+
+// A listening socket on the loopback interface, for the self tests'
+// stand-ins for the controller's servers
+class TcpListener {
+private:
+    intptr_t m_fd = -1;
+
+public:
+    TcpListener() = default;
+    ~TcpListener();
+    TcpListener(const TcpListener&)            = delete;
+    TcpListener& operator=(const TcpListener&) = delete;
+
+    // Listens on 127.0.0.1:`port`, or on a free port if `port` is 0, and
+    // sets `port` to the one chosen.  Returns false on error.
+    bool listen(uint16_t& port);
+
+    // Returns false if no connection arrives within `ms`
+    bool accept(TcpSocket& client, uint32_t ms);
+
+    void close();
+};
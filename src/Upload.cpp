@@ -0,0 +1,720 @@
+#include "Upload.h"
+#include "Xmodem.h"
+#include "Deflate.h"
+#include "HttpUpload.h"
+#include "RemoteCache.h"
+#include "LinkTiming.h"
+#include "FileSystem.h"
+#include "RemoteFiles.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Cleared once the controller has shown that it only speaks XMODEM, so
+// later uploads skip the YMODEM header and the wait that detects it
+static bool ymodemReceiver = true;
+
+static uint32_t lineBaud = 115200;
+
+void setUploadBaud(uint32_t baud) {
+    lineBaud = baud;
+    linkTiming().setBaud(baud);
+}
+
+// Compares the effective throughput with what the line can carry
+static void reportThroughput(const XmodemStats& stats) {
+    if (stats.seconds <= 0 || !stats.bytes) {
+        return;
+    }
+    double lineRate = lineBaud / 10.0;  // 8N1 bytes per second
+    double rate     = stats.bytes / stats.seconds;
+    char   text[160];
+    snprintf(text,
+             sizeof(text),
+             "%llu bytes in %.1f s, %.0f bytes/s, %.0f%% of the %lu baud line rate%s",
+             (unsigned long long)stats.bytes,
+             stats.seconds,
+             rate,
+             100 * rate / lineRate,
+             (unsigned long)lineBaud,
+             stats.streaming ? " (streaming)" : "");
+    std::cout << std::endl << text << std::endl;
+    const LinkTiming& timing = linkTiming();
+    if (timing.valid()) {
+        snprintf(text,
+                 sizeof(text),
+                 "Round trip %.1f ms +/- %.1f ms, 1K packet timeout %lu ms",
+                 timing.srtt(),
+                 timing.rttvar(),
+                 (unsigned long)timing.timeout(1000, 1029));
+        std::cout << text << std::endl;
+    }
+}
+
+// Asks FluidNC to receive a file and waits for it to request the first
+// packet.  Returns 0 when the transfer can start, leaving the port in
+// direct mode, or -1 if FluidNC refused.
+static int startReceive(SerialPort& comport, const std::string& remoteName) {
+    std::string msg = "$Xmodem/Receive=";
+    msg += remoteName;
+    msg += '\n';
+    comport.setDirect();
+    comport.write(msg);
+    int ch;
+    while (true) {
+        ch = comport.timedRead(1);
+
+        if (ch == -1) {
+        } else if (ch == 0x18 || ch == 0x04) {
+            // 0x18 is the correct cancel character but older FluidNC versions use 0x04
+            std::cout << "FluidNC cancelled the upload" << std::endl;
+            comport.setIndirect();
+            return -1;
+        } else if (ch == 'C') {
+            return 0;
+        } else if (ch == '$') {
+            std::cout << (char)ch;
+            // FluidNC is echoing the line
+            do {
+                ch = comport.timedRead(1);
+                if (ch != -1) {
+                    std::cout << (char)ch;
+                }
+            } while (ch != '\n');
+        } else if (ch == '\n') {
+            std::cout << (char)ch;
+        } else if (ch == 'e') {
+            // Probably an "error:N" message
+            std::cout << (char)ch;
+            comport.setIndirect();
+            return -1;
+        }
+    }
+}
+
+// Hashes what the receiver writes instead of keeping it
+class HashSink : public std::streambuf {
+private:
+    Sha256 m_hash;
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        m_hash.update(s, size_t(n));
+        return n;
+    }
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) {
+            char ch = char(c);
+            m_hash.update(&ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+public:
+    std::string hex() { return m_hash.hex(); }
+};
+
+// The size of a remote file from its directory listing, -1 if unknown
+static int64_t remoteSize(SerialPort& comport, const std::string& remoteName) {
+    auto                    slash = remoteName.rfind('/');
+    std::string             dir   = slash == std::string::npos ? "" : remoteName.substr(0, slash + 1);
+    std::string             tail  = remoteName.substr(slash == std::string::npos ? 0 : slash + 1);
+    std::vector<RemoteFile> files;
+    if (listRemoteFiles(comport, dir, files)) {
+        for (auto& file : files) {
+            if (file.name == tail) {
+                return file.size;
+            }
+        }
+    }
+    return -1;
+}
+
+// Runs $Xmodem/Send and receives the file into `out`
+static int receiveFile(SerialPort& comport, const std::string& remoteName, std::ostream& out, int64_t size) {
+    std::string msg = "$Xmodem/Send=";
+    msg += remoteName;
+    msg += '\n';
+    comport.setDirect();
+    comport.write('\f');  // Turn off echoing
+    comport.write(msg);
+    int ret = xmodemReceive(comport, out, size);
+    comport.write('\t');  // Echo mode on
+    return ret;
+}
+
+static bool verifyUploads  = true;
+static bool hashCommandOk  = true;  // cleared if FluidNC refuses $File/ShowHash
+
+void setUploadVerify(bool verify) {
+    verifyUploads = verify;
+}
+
+// The SHA-256 of a remote file.  FluidNC computes it if it can;
+// otherwise, with `download`, the file is fetched and hashed here.
+static bool remoteSha256(SerialPort& comport, const std::string& remoteName, bool download, std::string& hex) {
+    if (hashCommandOk) {
+        int ret = remoteFileHash(comport, remoteName, hex);
+        if (ret == 0) {
+            return true;
+        }
+        if (ret == -1) {
+            hashCommandOk = false;
+        }
+    }
+    if (!download) {
+        return false;
+    }
+    int64_t      size = remoteSize(comport, remoteName);
+    HashSink     sink;
+    std::ostream out(&sink);
+    if (size < 0 || receiveFile(comport, remoteName, out, size) != size) {
+        return false;
+    }
+    hex = sink.hex();
+    return true;
+}
+
+// Remote files whose contents were last verified to have a given hash,
+// keyed by port and remote name, so repeat uploads of the same file can
+// be skipped without a round trip
+static std::string verifiedPath() {
+    return cacheDirectory() + "/verified.txt";
+}
+
+static void loadVerified(std::map<std::string, std::string>& verified) {
+    std::ifstream in(verifiedPath());
+    std::string   line;
+    while (std::getline(in, line)) {
+        auto space = line.find(' ');
+        if (space == 64) {
+            verified[line.substr(65)] = line.substr(0, 64);
+        }
+    }
+}
+
+static void saveVerified(const std::map<std::string, std::string>& verified) {
+    makeDirectories(cacheDirectory());
+    std::ofstream out(verifiedPath());
+    for (auto& entry : verified) {
+        out << entry.second << ' ' << entry.first << std::endl;
+    }
+}
+
+static bool compressUploads = false;
+
+void setUploadCompress(bool compress) {
+    compressUploads = compress;
+}
+
+static bool endsWith(const std::string& s, const char* tail) {
+    size_t n = strlen(tail);
+    return s.length() >= n && s.compare(s.length() - n, n, tail) == 0;
+}
+
+// Config files are read by FluidNC itself, which cannot unzip them
+static bool compressible(const std::string& name) {
+    for (auto tail : { ".gz", ".yaml", ".yml", ".flnc" }) {
+        if (endsWith(name, tail)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string uploadedName(const std::string& remoteName) {
+    return compressUploads && compressible(remoteName) ? remoteName + ".gz" : remoteName;
+}
+
+// The bytes sent for one file: the file itself, or the gzip stream a
+// GzipCompressor makes of it as it is read
+struct UploadSource {
+    std::string                     path;
+    std::ifstream                   file;
+    std::unique_ptr<GzipCompressor> gzip;
+    std::istream                    in;
+    std::unique_ptr<MappedFile>     mapped;
+    std::string                     packed;
+
+    explicit UploadSource(const std::string& path) :
+        path(path), file(path, std::ifstream::in | std::ifstream::binary), in(file.rdbuf()) {}
+
+    void compress() {
+        gzip.reset(new GzipCompressor(file));
+        in.rdbuf(gzip.get());
+    }
+
+    // All the bytes at once, for HTTP: the file mapped into memory, or
+    // the compressed data
+    bool contents(const char*& data, size_t& size) {
+        if (gzip) {
+            if (packed.empty()) {
+                packed.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+                in.clear();
+                in.seekg(0);
+            }
+            data = packed.data();
+            size = packed.length();
+            return true;
+        }
+        if (!mapped) {
+            mapped.reset(new MappedFile(path));
+        }
+        data = mapped->data();
+        size = mapped->size();
+        return mapped->ok();
+    }
+};
+
+static std::string webServer;      // host[:port] of FluidNC's web server
+static int         webState = 0;  // 0 until looked for, 1 if in use, -1 if not available
+
+void setUploadHost(const std::string& address) {
+    webServer = address;
+    webState  = address == "off" ? -1 : 0;
+}
+
+// Whether uploads can go to the web server.  Unless given one, looks
+// for the controller's IP address in the $I report, e.g.
+// "[MSG: Mode=STA:SSID=shop:Status=Connected:IP=192.168.1.20:MAC=...]".
+static bool webServerReady(SerialPort& comport) {
+    if (webState == 0 && webServer.empty()) {
+        std::vector<std::string> reply;
+        if (remoteCommand(comport, "$I", reply) == 0) {
+            for (auto& line : reply) {
+                auto ip = line.find("IP=");
+                if (ip != std::string::npos) {
+                    std::string address = line.substr(ip + 3, line.find_first_of(":]", ip + 3) - ip - 3);
+                    if (address.length() && address != "0.0.0.0") {
+                        webServer = address;
+                    }
+                }
+            }
+        }
+        if (webServer.empty()) {
+            webState = -1;
+        }
+    }
+    return webState >= 0;
+}
+
+// Sends a file over HTTP.  Returns false if it should go by XMODEM.
+static bool sendOverHttp(UploadItem& item, UploadSource& source) {
+    const char* data;
+    size_t      size;
+    if (!source.contents(data, size)) {
+        return false;
+    }
+    std::string host;
+    uint16_t    port;
+    splitHost(webServer, host, port);
+    std::cout << "HTTP Upload " << item.path << " " << item.remoteName << " to " << webServer << std::endl;
+    XmodemStats stats;
+    int         ret = httpUpload(host, port, item.remoteName, data, size, &stats);
+    if (ret < 0) {
+        std::cout << (ret == -1 ? "Cannot reach " : "Upload failed on ") << webServer << ", using XModem" << std::endl;
+        webState = -1;
+        return false;
+    }
+    webState = 1;
+    reportThroughput(stats);
+    return true;
+}
+
+// Sends the files in `send`, in YMODEM batches where possible.  Returns
+// how many were sent, in order.
+static size_t transmitFiles(SerialPort& comport, std::vector<UploadItem*>& send, std::vector<YmodemFile>& files,
+                            std::vector<std::unique_ptr<UploadSource>>& sources) {
+    size_t sent = 0;
+    // Wi-Fi is many times faster than the serial line, so it is used
+    // for as long as the web server takes the files
+    while (sent < files.size() && webServerReady(comport) && sendOverHttp(*send[sent], *sources[sent])) {
+        ++sent;
+    }
+    while (sent < files.size()) {
+        if (ymodemReceiver && files.size() - sent > 1) {
+            std::cout << "YModem Upload " << files.size() - sent << " files" << std::endl;
+        } else {
+            std::cout << "XModem Upload " << send[sent]->path << " " << send[sent]->remoteName << std::endl;
+        }
+        if (startReceive(comport, send[sent]->remoteName) < 0) {
+            break;
+        }
+        int         ret;
+        XmodemStats stats;
+        if (ymodemReceiver) {
+            std::vector<YmodemFile> batch(files.begin() + sent, files.end());
+            ret = ymodemTransmit(comport, batch, &stats);
+            if (ret > 0 && !batch[0].exact) {
+                ymodemReceiver = false;
+            }
+        } else {
+            ret = xmodemTransmit(comport, sources[sent]->in, &stats) < 0 ? -1 : 1;
+        }
+        comport.flushInput();
+        comport.setIndirect();
+        if (ret < 0) {
+            std::cout << "Returned " << ret << std::endl;
+            break;
+        }
+        reportThroughput(stats);
+        sent += ret;
+    }
+    return sent;
+}
+
+// Files open and compressing ahead of the one being checked or sent.
+// Each compressor has its own threads and holds its whole output, so
+// only a few run at once, and a long list never runs out of handles.
+static const size_t LOOKAHEAD = 3;
+
+// The most files sent in one YModem batch, which all stay open until
+// the batch is done
+static const size_t MAX_BATCH = 4;
+
+// Opens, compresses and hashes the files to upload on a background
+// thread, in order, so the serial line does not wait on the disk: while
+// one batch is checked and sent, the next files are read and hashed.
+class UploadPreparer {
+public:
+    struct Prepared {
+        std::unique_ptr<UploadSource> source;
+        std::string                   hash;
+        int64_t                       size = -1;  // bytes to send, -1 if the file cannot be read
+    };
+
+private:
+    std::vector<UploadItem>& m_items;
+    std::vector<Prepared>    m_prepared;
+    size_t                   m_ready = 0;
+    size_t                   m_taken = 0;  // items handed out by wait()
+    bool                     m_stop  = false;
+    std::mutex               m_mutex;
+    std::condition_variable  m_changed;
+    std::thread              m_thread;
+
+    void open(size_t i) {
+        auto& item   = m_items[i];
+        auto& source = m_prepared[i].source;
+        source.reset(new UploadSource(item.path));
+        if (source->file.is_open() && uploadedName(item.remoteName) != item.remoteName) {
+            item.remoteName = uploadedName(item.remoteName);
+            source->compress();
+        }
+    }
+
+    void run() {
+        // The files after the one being hashed compress meanwhile, up
+        // to LOOKAHEAD past the last one taken
+        size_t opened = 0;
+        for (size_t i = 0; i < m_items.size(); ++i) {
+            size_t limit;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [this, i] { return m_stop || i < m_taken + LOOKAHEAD; });
+                if (m_stop) {
+                    return;
+                }
+                limit = std::min(m_items.size(), m_taken + LOOKAHEAD);
+            }
+            while (opened < limit) {
+                open(opened++);
+            }
+            auto& prepared = m_prepared[i];
+            if (prepared.source->file.is_open()) {
+                // A compressed file is hashed and verified as sent
+                prepared.hash = sha256Stream(prepared.source->in);
+                prepared.size = prepared.source->gzip ? prepared.source->gzip->size() : fileSize(m_items[i].path.c_str());
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ready = i + 1;
+            m_changed.notify_all();
+        }
+    }
+
+public:
+    explicit UploadPreparer(std::vector<UploadItem>& items) : m_items(items), m_prepared(items.size()) {
+        m_thread = std::thread(&UploadPreparer::run, this);
+    }
+    ~UploadPreparer() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_changed.notify_all();
+        }
+        m_thread.join();
+    }
+
+    bool ready(size_t i) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return i < m_ready;
+    }
+    // Items must be waited for in order; each lets another file open
+    Prepared& wait(size_t i) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_taken = i + 1;
+        m_changed.notify_all();
+        m_changed.wait(lock, [this, i] { return i < m_ready; });
+        return m_prepared[i];
+    }
+};
+
+int uploadFiles(SerialPort& comport, std::vector<UploadItem>& items) {
+    std::map<std::string, std::string> verified;
+    loadVerified(verified);
+
+    UploadPreparer                             preparer(items);
+    std::vector<std::unique_ptr<UploadSource>> sources;  // of the files to send
+    std::vector<YmodemFile>                    files;
+    std::vector<UploadItem*>                   send;
+    std::vector<std::string>                   hashes;
+    int                                        done = 0;
+    size_t                                     next = 0;  // the next item to check
+    while (next < items.size() || send.size()) {
+        // Files are checked as they become ready, and the ones to send
+        // go as soon as the next one would have to be waited for
+        if (next < items.size() && (send.empty() || (send.size() < MAX_BATCH && preparer.ready(next)))) {
+            auto& item     = items[next];
+            auto& prepared = preparer.wait(next++);
+            auto& source   = prepared.source;
+            if (!source->file.is_open()) {
+                std::cout << "Can't open " << item.path << std::endl;
+                continue;
+            }
+            if (prepared.size < 0) {
+                std::cout << "Can't read " << item.path << std::endl;
+                continue;
+            }
+            if (source->gzip) {
+                int64_t size = fileSize(item.path.c_str());
+                std::cout << "Compressed " << item.path << " from " << size << " to " << prepared.size << " bytes";
+                if (size) {
+                    std::cout << " (" << 100 * prepared.size / size << "%)";
+                }
+                std::cout << std::endl;
+            }
+            std::string key = comport.m_portName + " " + item.remoteName;
+            std::string remote;
+            auto        it = verified.find(key);
+            if ((it != verified.end() && it->second == prepared.hash) ||
+                (remoteSha256(comport, item.remoteName, false, remote) && remote == prepared.hash)) {
+                std::cout << item.remoteName << " is already up to date" << std::endl;
+                verified[key] = prepared.hash;
+                item.done     = true;
+                ++done;
+                continue;
+            }
+            files.push_back({ &source->in, item.remoteName, prepared.size });
+            sources.push_back(std::move(source));
+            send.push_back(&item);
+            hashes.push_back(prepared.hash);
+            continue;
+        }
+
+        size_t sent = transmitFiles(comport, send, files, sources);
+        for (size_t i = 0; i < sent; ++i) {
+            remoteFileCache().added(send[i]->remoteName, files[i].size);
+            std::string key = comport.m_portName + " " + send[i]->remoteName;
+            if (verifyUploads) {
+                std::string remote;
+                if (!remoteSha256(comport, send[i]->remoteName, true, remote) || remote != hashes[i]) {
+                    std::cout << "Verifying " << send[i]->remoteName << " failed" << std::endl;
+                    verified.erase(key);
+                    continue;
+                }
+                std::cout << "Verified " << send[i]->remoteName << std::endl;
+            }
+            verified[key] = hashes[i];
+            send[i]->done = true;
+            ++done;
+        }
+        sources.clear();
+        files.clear();
+        send.clear();
+        hashes.clear();
+    }
+    saveVerified(verified);
+    return done || items.empty() ? done : -1;
+}
+
+// Matches * and ? wildcards, ignoring case on Windows
+static bool matchWildcard(const char* pattern, const char* name) {
+    const char* star  = nullptr;  // the last * seen, to backtrack to
+    const char* retry = nullptr;
+    auto        same  = [](char a, char b) {
+#ifdef _WIN32
+        return tolower((unsigned char)a) == tolower((unsigned char)b);
+#else
+        return a == b;
+#endif
+    };
+    while (*name) {
+        if (*pattern == '*') {
+            star  = pattern++;
+            retry = name;
+        } else if (*pattern == '?' || same(*pattern, *name)) {
+            ++pattern;
+            ++name;
+        } else if (star) {
+            pattern = star + 1;
+            name    = ++retry;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        ++pattern;
+    }
+    return *pattern == '\0';
+}
+
+bool addUploads(const std::string& arg, const std::string& remote, std::vector<UploadItem>& items) {
+    auto        slash = arg.find_last_of("/\\");
+    std::string dir   = slash == std::string::npos ? "." : arg.substr(0, slash);
+    std::string tail  = arg.substr(slash == std::string::npos ? 0 : slash + 1);
+    std::string into  = remote.length() && remote.back() != '/' ? remote + "/" : remote;
+
+    std::vector<FileInfo> entries;
+    bool                  pattern = tail.find_first_of("*?") != std::string::npos;
+    if (!pattern && !listDirectory(arg, entries)) {
+        if (fileSize(arg.c_str()) < 0) {
+            std::cout << "Can't find " << arg << std::endl;
+            return false;
+        }
+        items.push_back({ arg, remote.empty() || remote.back() == '/' ? remote + tail : remote });
+        return true;
+    }
+    if (pattern) {
+        if (!listDirectory(dir, entries)) {
+            std::cout << "Can't list " << dir << std::endl;
+            return false;
+        }
+    } else {
+        dir  = arg;
+        tail = "*";
+    }
+    size_t count = 0;
+    for (auto& entry : entries) {
+        if (!entry.isDir && matchWildcard(tail.c_str(), entry.name.c_str())) {
+            items.push_back({ dir + "/" + entry.name, into + entry.name });
+            ++count;
+        }
+    }
+    if (count == 0) {
+        std::cout << "No files match " << arg << std::endl;
+    }
+    return count > 0;
+}
+
+bool readUploadManifest(const std::string& path, const std::string& remote, std::vector<UploadItem>& items) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cout << "Can't open " << path << std::endl;
+        return false;
+    }
+    auto        slash = path.find_last_of("/\\");
+    std::string base  = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    std::string line;
+    bool        ok     = true;
+    int         number = 0;
+    while (std::getline(in, line)) {
+        ++number;
+        // Up to two words, each either quoted or without spaces
+        std::vector<std::string> words;
+        for (size_t i = 0; i < line.length() && line[i] != '#';) {
+            if (isspace((unsigned char)line[i])) {
+                ++i;
+            } else if (line[i] == '"') {
+                size_t end = line.find('"', i + 1);
+                words.push_back(line.substr(i + 1, end == std::string::npos ? end : end - i - 1));
+                i = end == std::string::npos ? line.length() : end + 1;
+            } else {
+                size_t end = i;
+                while (end < line.length() && !isspace((unsigned char)line[end])) {
+                    ++end;
+                }
+                words.push_back(line.substr(i, end - i));
+                i = end;
+            }
+        }
+        if (words.empty()) {
+            continue;
+        }
+        if (words.size() > 2) {
+            std::cout << path << ":" << number << ": expected a local path and a remote name" << std::endl;
+            ok = false;
+            continue;
+        }
+        // Local paths are relative to the manifest
+        std::string local = words[0];
+        bool        absolute = local[0] == '/' || local[0] == '\\' || (local.length() > 1 && local[1] == ':');
+        if (!absolute) {
+            local = base + local;
+        }
+        std::string into = remote.length() && remote.back() != '/' ? remote + "/" : remote;
+        ok &= addUploads(local, words.size() > 1 ? words[1] : into, items);
+    }
+    return ok;
+}
+
+int uploadFile(SerialPort& comport, const std::string& path, const std::string& remoteName) {
+    std::vector<UploadItem> items { { path, remoteName } };
+    if (uploadFiles(comport, items) != 1) {
+        return -1;
+    }
+    return int(fileSize(path.c_str()));
+}
+
+int downloadStream(SerialPort& comport, const std::string& remoteName, std::ostream& out, int64_t size) {
+    auto start = std::chrono::steady_clock::now();
+    int  ret   = receiveFile(comport, remoteName, out, size);
+    if (ret < 0) {
+        std::cout << "Returned " << ret << std::endl;
+        return ret;
+    }
+    if (size >= 0 && ret != size) {
+        std::cout << "Received " << ret << " bytes, expected " << size << std::endl;
+    }
+    XmodemStats stats;
+    stats.bytes   = ret;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    reportThroughput(stats);
+    return ret;
+}
+
+int downloadFile(SerialPort& comport, const std::string& remoteName, const std::string& path) {
+    // The listed size lets the receiver drop the padding exactly
+    int64_t size = remoteSize(comport, remoteName);
+    if (size < 0) {
+        std::cout << "Cannot find the size of " << remoteName << ", trailing Ctrl-Z's will be dropped" << std::endl;
+    }
+
+    std::vector<char> buffer(1 << 20);
+    std::ofstream     outfile;
+    outfile.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    outfile.open(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (outfile.fail()) {
+        std::cout << "Can't create " << path << std::endl;
+        return -1;
+    }
+    std::cout << "XModem Download " << remoteName << " " << path << std::endl;
+
+    int ret = downloadStream(comport, remoteName, outfile, size);
+    outfile.close();
+    if (ret < 0 || outfile.fail()) {
+        removeFile(path);
+        return -1;
+    }
+    return ret;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "SerialPort.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct UploadItem {
+    std::string path;        // local file
+    std::string remoteName;  // name on the controller
+    bool        done = false;  // set once the remote copy matches
+};
+
+// Sends local files to the FluidNC filesystem.  They go over Wi-Fi to
+// FluidNC's web server when it can be reached, else with
+// $Xmodem/Receive in one YMODEM batch, or one XMODEM session each if the
+// controller does not support YMODEM.  Files whose SHA-256 matches the
+// remote copy are skipped, and each file sent is verified by hash
+// afterwards.  Marks the items done and returns how many are, or
+// negative if none are.
+int uploadFiles(SerialPort& comport, std::vector<UploadItem>& items);
+
+// Adds the files a command line names: a file, the files in a
+// directory, or those matching * and ? in the last part of a path.  A
+// single file is stored as `remote`, or in it if it ends in '/'; the
+// others go in `remote` as a directory.  Returns false if there are
+// none.
+bool addUploads(const std::string& arg, const std::string& remote, std::vector<UploadItem>& items);
+
+// Adds the files listed in a manifest, one line each: a local path,
+// which addUploads expands, and optionally the remote name or
+// directory, else `remote`.  Paths with spaces are quoted, # starts a
+// comment, and local paths are relative to the manifest.  Returns false
+// if any line fails.
+bool readUploadManifest(const std::string& path, const std::string& remote, std::vector<UploadItem>& items);
+
+// Sends a local file to the FluidNC filesystem with $Xmodem/Receive.
+// Returns the number of bytes sent, or negative on error.
+int uploadFile(SerialPort& comport, const std::string& path, const std::string& remoteName);
+
+// Fetches a file from the FluidNC filesystem with $Xmodem/Send.
+// Returns the number of bytes received, or negative on error.
+int downloadFile(SerialPort& comport, const std::string& remoteName, const std::string& path);
+
+// Fetches a file from the FluidNC filesystem into `out` and reports the
+// throughput.  `size` is the listed size, or -1 if it is not known.
+// Returns the number of bytes received, or negative on error.
+int downloadStream(SerialPort& comport, const std::string& remoteName, std::ostream& out, int64_t size);
+
+// Where FluidNC's web server is, as host[:port], or "off" to upload
+// over the serial line only.  By default its address comes from $I.
+void setUploadHost(const std::string& address);
+
+// The line rate the transfer reports compare against
+void setUploadBaud(uint32_t baud);
+
+// Whether uploads are gzipped on the way.  FluidNC runs .gz G-code
+// directly; config files and files already compressed are sent as is.
+void setUploadCompress(bool compress);
+
+// The name a file uploaded as `remoteName` is stored under, with .gz
+// appended if it is compressed
+std::string uploadedName(const std::string& remoteName);
+
+// Whether uploads are checked by hash afterwards.  Without FluidNC's
+// $File/ShowHash the check downloads the file again.
+void setUploadVerify(bool verify);
@@ -33,40 +33,17 @@
  */
 
 #include "Xmodem.h"
+#include "Crc.h"
+#include "LinkTiming.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <thread>
 #include <chrono>
 
-/* CRC16 implementation acording to CCITT standards */
-
-static const uint16_t crc16tab[256] = {
-    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
-    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6, 0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
-    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485, 0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
-    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4, 0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
-    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823, 0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
-    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12, 0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
-    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41, 0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
-    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70, 0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
-    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f, 0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
-    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e, 0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
-    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d, 0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
-    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c, 0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
-    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab, 0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
-    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a, 0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
-    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9, 0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
-    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8, 0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
-};
-
-static uint16_t crc16_ccitt(const char* buf, size_t len) {
-    int      counter;
-    uint16_t crc = 0;
-    for (counter = 0; counter < len; counter++)
-        crc = (crc << 8) ^ crc16tab[((crc >> 8) ^ (uint8_t)(*buf++)) & 0x00FF];
-    return crc;
-}
-
 #define SOH 0x01
 #define STX 0x02
 #define EOT 0x04
@@ -81,7 +58,7 @@ static uint16_t crc16_ccitt(const char* buf, size_t len) {
 
 static int check(int crc, const char* buf, int sz) {
     if (crc) {
-        uint16_t crc  = crc16_ccitt(buf, sz);
+        uint16_t crc  = crc16Ccitt(0, buf, sz);
         uint16_t tcrc = ((uint8_t)buf[sz] << 8) + (uint8_t)buf[sz + 1];
         if (crc == tcrc) {
             return 1;
@@ -111,13 +88,14 @@ static int check(int crc, const char* buf, int sz) {
 // control-Z's.  Doing the control-Z removal only on the final
 // packet avoids removing interior control-Z's that happen to
 // land at the end of a packet.
-static bool held = false;
-static char held_packet[1024];
-static void flush_packet(std::ostream& out, size_t packet_len, size_t& total_len) {
+static bool   held = false;
+static char   held_packet[1024];
+static size_t held_len;
+static void flush_packet(std::ostream& out, size_t& total_len) {
     if (held) {
         // Remove trailing ctrl-z's on the final packet
         size_t count;
-        for (count = packet_len; count > 0; --count) {
+        for (count = held_len; count > 0; --count) {
             if (held_packet[count - 1] != CTRLZ) {
                 break;
             }
@@ -128,29 +106,70 @@ static void flush_packet(std::ostream& out, size_t packet_len, size_t& total_len
 }
 static void write_packet(std::ostream& out, const char* buf, size_t packet_len, size_t& total_len) {
     if (held) {
-        out.write(held_packet, packet_len);
-        total_len += packet_len;
+        out.write(held_packet, held_len);
+        total_len += held_len;
     }
     memcpy(held_packet, buf, packet_len);
-    held = true;
+    held_len = packet_len;
+    held     = true;
+}
+// Reads a packet body in as few reads as the port allows, rather than
+// byte by byte.  Returns the number of bytes read before the line went
+// quiet for `ms`.
+static size_t readBytes(SerialPort& serial, char* buf, size_t len, uint32_t ms) {
+    size_t got = 0;
+    while (got < len) {
+        int n = serial.timedRead(buf + got, len - got, ms);
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    return got;
+}
+
+static double msSince(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
 }
-static int _xmodemReceive(SerialPort& serial, std::ostream& out) {
+
+// With a known size, packets are cut to exactly the bytes remaining
+// and no Ctrl-Z trimming is needed
+static void write_sized(std::ostream& out, const char* buf, size_t packet_len, int64_t& remaining, size_t& total_len) {
+    size_t count = remaining < int64_t(packet_len) ? size_t(remaining) : packet_len;
+    out.write(buf, count);
+    remaining -= count;
+    total_len += count;
+}
+
+static int _xmodemReceive(SerialPort& serial, std::ostream& out, int64_t size) {
     char    xbuff[1030]; /* 1024 for XModem 1k + 3 head chars + 2 crc + nul */
-    char*   p;
     int     bufsz = 0, crc = 0;
     char    trychar  = 'C';
     uint8_t packetno = 1;
-    int     i, c           = 0;
+    int     c        = 0;
     int     retry, retrans = MAXRETRANS;
+    bool    ymodem    = false;
+    int64_t remaining = size;  // -1 if unknown
 
     size_t len = 0;
+    held       = false;
+
+    // The time from an ACK to the next packet is a round trip sample
+    LinkTiming&                           timing = linkTiming();
+    std::chrono::steady_clock::time_point ackTime;
+    bool                                  acked = false;
 
     for (;;) {
         for (retry = 0; retry < 16; ++retry) {
             if (trychar) {
                 serial.write(trychar);
             }
+            // A NAK sent early would make the sender resend a packet it
+            // is still sending, so this wait stays long
             if ((c = serial.timedRead(2000)) >= 0) {
+                if ((c == SOH || c == STX) && acked && retry == 0) {
+                    timing.sample(msSince(ackTime));
+                }
                 switch (c) {
                     case SOH:
                         bufsz = 128;
@@ -159,11 +178,28 @@ static int _xmodemReceive(SerialPort& serial, std::ostream& out) {
                         bufsz = 1024;
                         goto start_recv;
                     case EOT:
-                        flush_packet(out, bufsz, len);
+                        if (remaining < 0) {
+                            flush_packet(out, len);
+                        }
                         serial.write(ACK);
+                        if (ymodem) {
+                            // Take the empty block 0 that ends the batch.
+                            // Only one file is wanted, so stop any other.
+                            serial.write('C');
+                            if ((c = serial.timedRead(2000)) == SOH || c == STX) {
+                                readBytes(serial, xbuff, (c == STX ? 1024 : 128) + 4, timing.timeout(DLY_1S));
+                                if (xbuff[2] == '\0') {
+                                    serial.write(ACK);
+                                } else {
+                                    serial.write(CAN);
+                                    serial.write(CAN);
+                                    serial.write(CAN);
+                                }
+                            }
+                        }
                         return len; /* normal end */
                     case CAN:
-                        if ((c = serial.timedRead(1000)) == CAN) {
+                        if ((c = serial.timedRead(timing.timeout(DLY_1S))) == CAN) {
                             serial.write(ACK);
                             return -1; /* canceled by remote */
                         }
@@ -172,6 +208,7 @@ static int _xmodemReceive(SerialPort& serial, std::ostream& out) {
                         break;
                 }
             }
+            acked = false;
         }
         if (trychar == 'C') {
             trychar = NAK;
@@ -185,22 +222,40 @@ static int _xmodemReceive(SerialPort& serial, std::ostream& out) {
     start_recv:
         if (trychar == 'C')
             crc = 1;
-        trychar = 0;
-        p       = xbuff;
-        *p++    = c;
-        for (i = 0; i < (bufsz + (crc ? 1 : 0) + 3); ++i) {
-            ;
-            if ((c = serial.timedRead(1000)) < 0) {
-                goto reject;
-            }
-            *p++ = c;
+        trychar  = 0;
+        xbuff[0] = c;
+        acked    = false;
+        // Once a packet starts its bytes come back to back, so a gap
+        // longer than the round trip timeout means it was cut short
+        if (readBytes(serial, xbuff + 1, bufsz + (crc ? 1 : 0) + 3, timing.timeout(DLY_1S)) != size_t(bufsz + (crc ? 1 : 0) + 3)) {
+            goto reject;
         }
 
-        if (xbuff[1] == ~xbuff[2] && ((uint8_t)xbuff[1] == packetno || (uint8_t)xbuff[1] == packetno - 1) && check(crc, &xbuff[3], bufsz)) {
-            if (xbuff[1] == packetno) {
-                write_packet(out, xbuff + 3, bufsz, len);
+        if (xbuff[1] == ~xbuff[2] && ((uint8_t)xbuff[1] == packetno || (uint8_t)xbuff[1] == uint8_t(packetno - 1)) && check(crc, &xbuff[3], bufsz)) {
+            if ((uint8_t)xbuff[1] == 0 && packetno == 1 && crc && !ymodem) {
+                // YMODEM block 0: name, NUL, decimal size
+                ymodem = true;
+                serial.write(ACK);
+                if (xbuff[3] == '\0') {
+                    return 0; /* empty batch */
+                }
+                const char* name = &xbuff[3];
+                const char* nul  = static_cast<const char*>(memchr(name, '\0', bufsz - 1));
+                if (nul && nul[1] >= '0' && nul[1] <= '9') {
+                    remaining = strtoll(nul + 1, nullptr, 10);
+                }
+                trychar = 'C';  // ask for the data
+                continue;
+            }
+            if ((uint8_t)xbuff[1] == packetno) {
+                if (remaining >= 0) {
+                    write_sized(out, xbuff + 3, bufsz, remaining, len);
+                } else {
+                    write_packet(out, xbuff + 3, bufsz, len);
+                }
                 ++packetno;
                 retrans = MAXRETRANS + 1;
+                acked   = true;
             }
             if (--retrans <= 0) {
                 serial.write(CAN);
@@ -209,138 +264,400 @@ static int _xmodemReceive(SerialPort& serial, std::ostream& out) {
                 return -3; /* too many retry error */
             }
             serial.write(ACK);
+            ackTime = std::chrono::steady_clock::now();
             continue;
         }
     reject:
+        serial.flushInput();
         serial.write(NAK);
     }
     // Unreached
     return 0;
 }
-int xmodemReceive(SerialPort& serial, std::ostream& out) {
+int xmodemReceive(SerialPort& serial, std::ostream& out, int64_t size) {
     serial.setDirect();
-    using namespace std::chrono_literals;
-    std::this_thread::sleep_for(1s);
-    int retval = _xmodemReceive(serial, out);
+    // Give the sender time to open the file before asking for it
+    std::this_thread::sleep_for(std::chrono::milliseconds(linkTiming().timeout(DLY_1S)));
+    int retval = _xmodemReceive(serial, out, size);
     serial.flushInput();
     serial.setIndirect();
     return retval;
 }
 
-int xmodemTransmit(SerialPort& serial, std::ifstream& infile) {
-    char    xbuff[1030]; /* 1024 for XModem 1k + 3 head chars + 2 crc + nul */
-    size_t  bufsz;
-    bool    crc      = true;
-    uint8_t packetno = 1;
-    int     i, c = 0;
-    size_t  len = 0;
-    int     retry;
+// How the receiver asked for packets
+enum Mode { CHECKSUM, CRC16, STREAM };
 
-    for (;;) {
-        for (retry = 0; retry < 16; ++retry) {
-            if ((c = serial.timedRead(2000)) >= 0) {
-                switch (c) {
-                    case 'C':
-                        crc = true;
-                        goto start_trans;
-                    case NAK:
-                        crc = false;
-                        goto start_trans;
-                    case CAN:
-                        if ((c = serial.timedRead(1000)) == CAN) {
-                            serial.write(ACK);
-                            return -1; /* canceled by remote */
+static uint64_t wireBytes;  // bytes written by the transmitter, including resends
+
+static void put(SerialPort& serial, const char* data, size_t len) {
+    serial.write(data, len);
+    wireBytes += len;
+}
+
+// Waits for the receiver to ask for packets: NAK for checksums, 'C'
+// for CRC-16, or 'G' to stream CRC-16 packets without ACKs (XMODEM-G).
+// Returns the Mode or negative.
+static int waitStart(SerialPort& serial, int tries, uint32_t ms) {
+    int c;
+    for (int retry = 0; retry < tries; ++retry) {
+        if ((c = serial.timedRead(ms)) >= 0) {
+            switch (c) {
+                case 'G':
+                    return STREAM;
+                case 'C':
+                    return CRC16;
+                case NAK:
+                    return CHECKSUM;
+                case CAN:
+                    if ((c = serial.timedRead(linkTiming().timeout(DLY_1S))) == CAN) {
+                        serial.write(ACK);
+                        return -1; /* canceled by remote */
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return -2; /* no sync */
+}
+
+static void cancel(SerialPort& serial) {
+    serial.write(CAN);
+    serial.write(CAN);
+    serial.write(CAN);
+}
+
+// Fills in the header and check bytes around the data in xbuff[3..].
+// Returns the packet length.
+static size_t makePacket(char* xbuff, size_t bufsz, uint8_t packetno, bool crc) {
+    xbuff[0] = bufsz == 1024 ? STX : SOH;
+    xbuff[1] = packetno;
+    xbuff[2] = ~packetno;
+    if (crc) {
+        uint16_t ccrc    = crc16Ccitt(0, &xbuff[3], bufsz);
+        xbuff[bufsz + 3] = (ccrc >> 8) & 0xFF;
+        xbuff[bufsz + 4] = ccrc & 0xFF;
+    } else {
+        uint8_t ccks = 0;
+        for (size_t i = 3; i < bufsz + 3; ++i) {
+            ccks += xbuff[i];
+        }
+        xbuff[bufsz + 3] = ccks;
+    }
+    return bufsz + 4 + (crc ? 1 : 0);
+}
+
+// Sends a packet until the receiver ACKs it.  The wait for the ACK
+// comes from the measured round trip, so a lost packet is resent in
+// tens of milliseconds rather than a second.  A packet resent after a
+// timeout may have arrived after all, in which case its copy is ACKed
+// too; that second ACK is dropped so it is not taken for the next
+// packet's.  Gives up after MAXRETRANS NAKs or full-second timeouts.
+static int sendPacket(SerialPort& serial, const char* xbuff, size_t length) {
+    LinkTiming&                           timing   = linkTiming();
+    int                                   c;
+    bool                                  echoing  = false;
+    bool                                  resent   = false;
+    bool                                  timedOut = false;
+    int                                   sends    = 0;
+    std::chrono::steady_clock::time_point sentTime;
+    for (int retry = 0; retry < MAXRETRANS;) {
+        uint32_t wait = timing.timeout(DLY_1S, length);
+        if (!echoing) {
+            put(serial, xbuff, length);
+            sentTime = std::chrono::steady_clock::now();
+            resent   = sends++ > 0;
+        }
+        if ((c = serial.timedRead(wait)) >= 0) {
+            switch (c) {
+                case ACK:
+                    if (!resent) {
+                        timing.sample(msSince(sentTime), length);
+                    } else if (timedOut) {
+                        // If this was the original's ACK, the copy's is due
+                        // one round trip after the copy was sent
+                        double left = timing.due(DLY_1S, length) - msSince(sentTime);
+                        if (left > 0) {
+                            serial.timedRead(uint32_t(left));
                         }
-                        break;
-                    default:
-                        break;
-                }
+                    }
+                    return 0;
+                case CAN:
+                    if ((c = serial.timedRead(timing.timeout(DLY_1S))) == CAN) {
+                        serial.write(ACK);
+                        return -1; /* canceled by remote */
+                    }
+                    break;
+                case NAK:
+                    std::cout << " NAK ";
+                    echoing = false;
+                    ++retry;
+                    break;
+                default:
+                    std::cout << char(c);
+                    echoing = true;
+                    break;
+            }
+        } else {
+            std::cout << " Timeout ";
+            echoing  = false;
+            timedOut = true;
+            timing.backoff();
+            if (wait >= DLY_1S) {
+                ++retry;
             }
         }
-        serial.write(CAN);
-        serial.write(CAN);
-        serial.write(CAN);
-        return -2; /* no sync */
+    }
+    cancel(serial);
+    std::cout << std::endl << "Giving up" << std::endl;
+    return -4; /* xmit error */
+}
+
+// Reads the file and builds its packets on a background thread, so the
+// next packet is ready the moment the receiver takes the last one.
+// The final packet is padded with Ctrl-Z, and is a 128-byte packet if
+// that holds what is left.  A packet with no data marks the end.
+class Packetizer {
+public:
+    struct Packet {
+        char   xbuff[1030]; /* 1024 for XModem 1k + 3 head chars + 2 crc + nul */
+        size_t length;
+        size_t nbytes;
+    };
+
+private:
+    static const size_t SLOTS = 16;
+
+    std::istream&             m_in;
+    bool                      m_crc;
+    Packet                    m_packets[SLOTS - 1];
+    SpscQueue<Packet*, SLOTS> m_full;
+    SpscQueue<Packet*, SLOTS> m_free;
+    std::atomic<bool>         m_stop { false };
+    std::thread               m_thread;
+
+    bool take(SpscQueue<Packet*, SLOTS>& queue, Packet*& packet) {
+        while (!queue.pop(packet)) {
+            if (m_stop) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
 
-        for (;;) {
-        start_trans:
+    void run() {
 #ifdef TRANSMIT_XMODEM_1K
-            xbuff[0] = STX;
-            bufsz    = 1024;
+        const size_t maxsz = 1024;
 #else
-            xbuff[0] = SOH;
-            bufsz    = 128;
+        const size_t maxsz = 128;
 #endif
-            xbuff[1] = packetno;
-            xbuff[2] = ~packetno;
-
-            infile.read(&xbuff[3], (size_t)bufsz);
-            size_t nbytes = infile.gcount();
-            if (nbytes > 0) {
-                while (nbytes < bufsz) {
-                    xbuff[3 + nbytes] = CTRLZ;
-                    nbytes++;
-                }
-                if (crc) {
-                    uint16_t ccrc    = crc16_ccitt(&xbuff[3], bufsz);
-                    xbuff[bufsz + 3] = (ccrc >> 8) & 0xFF;
-                    xbuff[bufsz + 4] = ccrc & 0xFF;
-                } else {
-                    uint8_t ccks = 0;
-                    for (i = 3; i < bufsz + 3; ++i) {
-                        ccks += xbuff[i];
-                    }
-                    xbuff[bufsz + 3] = ccks;
-                }
-                bool echoing = false;
-                for (retry = 0; retry < MAXRETRANS;) {
-                    if (!echoing) {
-                        serial.write(xbuff, bufsz + 4 + (crc ? 1 : 0));
-                        ++retry;
-                    }
-                    if ((c = serial.timedRead(1000)) >= 0) {
-                        switch (c) {
-                            case ACK:
-                                ++packetno;
-                                std::cout << int(packetno) << '\r';
-                                len += bufsz;
-                                goto start_trans;
-                            case CAN:
-                                if ((c = serial.timedRead(1000)) == CAN) {
-                                    serial.write(ACK);
-                                    return -1; /* canceled by remote */
-                                }
-                                break;
-                            case NAK:
-                                std::cout << " NAK ";
-                                echoing = false;
-                                break;
-                            default:
-                                std::cout << char(c);
-                                echoing = true;
-                                break;
-                        }
-                    } else {
-                        std::cout << " Timeout ";
-                        echoing = false;
-                    }
-                }
-                serial.write(CAN);
-                serial.write(CAN);
-                serial.write(CAN);
-                std::cout << std::endl << "Giving up" << std::endl;
-                return -4; /* xmit error */
-            } else {
-                for (retry = 0; retry < 10; ++retry) {
-                    serial.write(EOT);
-                    if ((c = serial.timedRead(2000)) == ACK) {
-                        break;
-                    }
+        uint8_t packetno = 1;
+        Packet* packet;
+        while (take(m_free, packet)) {
+            m_in.read(&packet->xbuff[3], maxsz);
+            packet->nbytes = size_t(m_in.gcount());
+            if (packet->nbytes) {
+                size_t bufsz = packet->nbytes <= 128 ? 128 : 1024;
+                memset(&packet->xbuff[3 + packet->nbytes], CTRLZ, bufsz - packet->nbytes);
+                packet->length = makePacket(packet->xbuff, bufsz, packetno++, m_crc);
+            }
+            m_full.push(packet);
+            if (!packet->nbytes) {
+                break;
+            }
+        }
+    }
+
+public:
+    Packetizer(std::istream& in, bool crc) : m_in(in), m_crc(crc) {
+        for (Packet& packet : m_packets) {
+            m_free.push(&packet);
+        }
+        m_thread = std::thread(&Packetizer::run, this);
+    }
+    ~Packetizer() {
+        m_stop = true;
+        m_thread.join();
+    }
+
+    Packet* next() {
+        Packet* packet = nullptr;
+        take(m_full, packet);
+        return packet;
+    }
+    void release(Packet* packet) { m_free.push(packet); }
+};
+
+// Sends the file as packets 1, 2, ... followed by EOT.  Returns the
+// number of bytes sent or negative.
+static int sendData(SerialPort& serial, std::istream& infile, int mode) {
+    Packetizer packets(infile, mode != CHECKSUM);
+    uint8_t    packetno = 1;
+    size_t     len      = 0;
+    int        c        = 0;
+    int        retry;
+
+    for (;;) {
+        Packetizer::Packet* packet = packets.next();
+        size_t              nbytes = packet->nbytes;
+        if (nbytes == 0) {
+            packets.release(packet);
+            break;
+        }
+        if (mode == STREAM) {
+            // The receiver cancels if a packet is bad, and otherwise
+            // stays quiet until EOT
+            put(serial, packet->xbuff, packet->length);
+            packets.release(packet);
+            while ((c = serial.timedRead(0)) >= 0) {
+                if (c == CAN && serial.timedRead(linkTiming().timeout(DLY_1S)) == CAN) {
+                    serial.write(ACK);
+                    std::cout << std::endl << "Receiver cancelled the streaming transfer" << std::endl;
+                    return -1; /* canceled by remote */
                 }
-                return (c == ACK) ? len : -5;
+            }
+        } else {
+            int ret = sendPacket(serial, packet->xbuff, packet->length);
+            packets.release(packet);
+            if (ret < 0) {
+                return ret;
             }
         }
+        ++packetno;
+        std::cout << int(packetno) << '\r';
+        len += nbytes;
+    }
+    // The receiver may close the file before it ACKs, so this wait is
+    // not a round trip and stays long
+    for (retry = 0; retry < 10; ++retry) {
+        put(serial, "\x04", 1);  // EOT
+        if ((c = serial.timedRead(2000)) == ACK) {
+            break;
+        }
+    }
+    return (c == ACK) ? len : -5;
+}
+
+// Sends YMODEM block 0: the file name and decimal size, NUL-separated.
+// An empty name ends the batch.  A streaming receiver does not ACK it.
+static int sendHeader(SerialPort& serial, const std::string& name, int64_t size, int mode) {
+    char        xbuff[1030];
+    std::string info = name;
+    if (name.length()) {
+        info += '\0';
+        info += std::to_string(size);
+    }
+    size_t bufsz = info.length() < 128 ? 128 : 1024;
+    if (info.length() >= bufsz) {
+        std::cout << "File name too long: " << name << std::endl;
+        cancel(serial);
+        return -6;
+    }
+    memset(&xbuff[3], 0, bufsz);
+    memcpy(&xbuff[3], info.data(), info.length());
+    size_t length = makePacket(xbuff, bufsz, 0, mode != CHECKSUM);
+    if (mode == STREAM) {
+        put(serial, xbuff, length);
+        return 0;
+    }
+    return sendPacket(serial, xbuff, length);
+}
+
+static void finishStats(XmodemStats* stats, std::chrono::steady_clock::time_point start, int mode) {
+    if (stats) {
+        stats->wire      = wireBytes;
+        stats->seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats->streaming = mode == STREAM;
+    }
+}
+
+int xmodemTransmit(SerialPort& serial, std::istream& infile, XmodemStats* stats) {
+    int mode = waitStart(serial, 16, 2000);
+    if (mode < 0) {
+        if (mode == -2) {
+            cancel(serial);
+        }
+        return mode;
+    }
+    auto start = std::chrono::steady_clock::now();
+    wireBytes  = 0;
+    int ret    = sendData(serial, infile, mode);
+    finishStats(stats, start, mode);
+    if (stats && ret > 0) {
+        stats->bytes = ret;
+    }
+    return ret;
+}
+
+int ymodemTransmit(SerialPort& serial, std::vector<YmodemFile>& files, XmodemStats* stats) {
+    int mode = waitStart(serial, 16, 2000);
+    if (mode < 0) {
+        if (mode == -2) {
+            cancel(serial);
+        }
+        return mode;
+    }
+    auto start = std::chrono::steady_clock::now();
+    wireBytes  = 0;
+    if (stats) {
+        stats->bytes = 0;
+    }
+    if (files.empty()) {
+        return sendHeader(serial, "", 0, mode);
+    }
+    int ret;
+    if (mode == CHECKSUM) {
+        // YMODEM needs CRCs, so this is a plain XMODEM receiver
+        ret = sendData(serial, *files[0].in, mode);
+        finishStats(stats, start, mode);
+        if (ret < 0) {
+            return ret;
+        }
+        if (stats) {
+            stats->bytes = ret;
+        }
+        return 1;
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+        ret = sendHeader(serial, files[i].name, files[i].size, mode);
+        if (ret < 0) {
+            return ret;
+        }
+        // A YMODEM receiver asks for the data once it has the header.
+        // An XMODEM receiver takes block 0 as a repeat of the packet
+        // before packet 1, ACKs it and waits silently for packet 1.
+        // The receiver opens the file first, so the wait stays long.
+        bool ymodem = waitStart(serial, 1, 1000) == mode;
+        ret         = sendData(serial, *files[i].in, mode);
+        if (ret < 0) {
+            return ret;
+        }
+        if (stats) {
+            stats->bytes += ret;
+        }
+        if (!ymodem) {
+            finishStats(stats, start, mode);
+            return 1;
+        }
+        files[i].exact = true;
+        if (ret != files[i].size) {
+            std::cout << files[i].name << " changed size while sending" << std::endl;
+        }
+        if ((ret = waitStart(serial, 16, 2000)) != mode) {
+            if (ret == -2) {
+                cancel(serial);
+            }
+            return ret < 0 ? ret : -2;
+        }
+    }
+    ret = sendHeader(serial, "", 0, mode);
+    if (ret == 0 && mode == STREAM) {
+        serial.timedRead(1000);  // The ACK of the empty block 0, if any
     }
+    finishStats(stats, start, mode);
+    return ret < 0 ? ret : int(files.size());
 }
 
 #ifdef TEST_XMODEM_RECEIVE
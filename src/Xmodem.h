@@ -1,7 +1,39 @@
 #pragma once
 
 #include "SerialPort.h"
+#include <cstdint>
 #include <fstream>
+#include <string>
+#include <vector>
 
-int xmodemReceive(SerialPort& serial, std::ostream& out);
-int xmodemTransmit(SerialPort& serial, std::ifstream& in);
+// What a transfer cost on the wire
+struct XmodemStats {
+    uint64_t bytes     = 0;  // file data
+    uint64_t wire      = 0;  // everything written, including headers and resends
+    double   seconds   = 0;
+    bool     streaming = false;  // the receiver asked for XMODEM-G / YMODEM-G
+};
+
+// Receives one file.  With a known `size`, or one from a YMODEM block 0,
+// the output is exactly that long; otherwise trailing Ctrl-Z's are
+// trimmed from the last packet.  Returns the number of bytes written,
+// or negative on error.
+int xmodemReceive(SerialPort& serial, std::ostream& out, int64_t size = -1);
+
+// Sends one file.  A receiver that asks with 'G' instead of 'C' gets the
+// packets streamed without waiting for each ACK.
+int xmodemTransmit(SerialPort& serial, std::istream& in, XmodemStats* stats = nullptr);
+
+// One file of a YMODEM batch
+struct YmodemFile {
+    std::istream* in;
+    std::string   name;  // the remote name, sent in block 0
+    int64_t       size;
+    bool          exact = false;  // set if the receiver took the size from block 0
+};
+
+// Sends several files in one session.  Block 0 of each file carries its
+// name and size, so the receiver can cut the Ctrl-Z padding off exactly.
+// A receiver that only speaks XMODEM gets just the first file.  Returns
+// the number of files sent, or negative on error.
+int ymodemTransmit(SerialPort& serial, std::vector<YmodemFile>& files, XmodemStats* stats = nullptr);
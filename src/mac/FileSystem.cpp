@@ -0,0 +1,91 @@
+#include "FileSystem.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+int64_t fileSize(const char* name) {
+    struct stat st;
+    if (stat(name, &st) != 0) {
+        return -1;
+    }
+    return st.st_size;
+}
+
+bool listDirectory(const std::string& dir, std::vector<FileInfo>& entries) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+    while (struct dirent* e = readdir(d)) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) {
+            continue;
+        }
+        std::string path = dir + "/" + e->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        entries.push_back({ e->d_name, int64_t(st.st_size), int64_t(st.st_mtime), S_ISDIR(st.st_mode) });
+    }
+    closedir(d);
+    return true;
+}
+
+bool makeDirectories(const std::string& path) {
+    for (size_t pos = 0; pos != std::string::npos;) {
+        pos              = path.find('/', pos + 1);
+        std::string part = path.substr(0, pos);
+        if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool removeFile(const std::string& path) {
+    return unlink(path.c_str()) == 0;
+}
+
+bool touchFile(const std::string& path) {
+    return utimes(path.c_str(), NULL) == 0;
+}
+
+std::string cacheDirectory() {
+    const char* home = getenv("HOME");
+    std::string dir  = home ? home : ".";
+    return dir + "/Library/Caches/FluidTerm";
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        m_size = size_t(st.st_size);
+        if (m_size == 0) {
+            m_ok = true;  // mmap() refuses empty files
+        } else {
+            void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, m_size, MADV_SEQUENTIAL);
+                m_data = static_cast<const char*>(p);
+                m_ok   = true;
+            }
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
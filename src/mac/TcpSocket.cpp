@@ -0,0 +1,147 @@
+#include "TcpSocket.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+TcpSocket::~TcpSocket() {
+    close();
+}
+
+void TcpSocket::close() {
+    if (m_fd >= 0) {
+        ::close(int(m_fd));
+        m_fd = -1;
+    }
+}
+
+static bool waitFor(int fd, short events, uint32_t ms) {
+    struct pollfd p = { fd, events, 0 };
+    int           n;
+    while ((n = poll(&p, 1, int(ms))) < 0 && errno == EINTR) {}
+    return n == 1;
+}
+
+bool TcpSocket::connect(const std::string& host, uint16_t port, uint32_t ms) {
+    close();
+    struct addrinfo hints = {};
+    hints.ai_family       = AF_UNSPEC;
+    hints.ai_socktype     = SOCK_STREAM;
+    struct addrinfo* list;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &list) != 0) {
+        return false;
+    }
+    for (struct addrinfo* ai = list; ai && m_fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        // Connect without blocking so the wait can be bounded
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        bool ok = ::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        if (!ok && errno == EINPROGRESS && waitFor(fd, POLLOUT, ms)) {
+            int       err = 0;
+            socklen_t len = sizeof(err);
+            ok            = getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+        }
+        if (!ok) {
+            ::close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, flags);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        m_fd = fd;
+    }
+    freeaddrinfo(list);
+    return m_fd >= 0;
+}
+
+bool TcpSocket::send(const char* data, size_t len, uint32_t ms) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (len) {
+        if (!waitFor(int(m_fd), POLLOUT, ms)) {
+            return false;
+        }
+        ssize_t n = ::send(int(m_fd), data, len, flags);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+int TcpSocket::recv(char* buf, size_t len, uint32_t ms) {
+    if (!waitFor(int(m_fd), POLLIN, ms)) {
+        return -1;
+    }
+    ssize_t n;
+    while ((n = ::recv(int(m_fd), buf, len, 0)) < 0 && errno == EINTR) {}
+    return int(n);
+}
+
+TcpListener::~TcpListener() {
+    close();
+}
+
+void TcpListener::close() {
+    if (m_fd >= 0) {
+        ::close(int(m_fd));
+        m_fd = -1;
+    }
+}
+
+bool TcpListener::listen(uint16_t& port) {
+    close();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family         = AF_INET;
+    addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+    addr.sin_port           = htons(port);
+    socklen_t len           = sizeof(addr);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), len) != 0 || ::listen(fd, 4) != 0 ||
+        getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) != 0) {
+        ::close(fd);
+        return false;
+    }
+    port = ntohs(addr.sin_port);
+    m_fd = fd;
+    return true;
+}
+
+bool TcpListener::accept(TcpSocket& client, uint32_t ms) {
+    if (m_fd < 0 || !waitFor(int(m_fd), POLLIN, ms)) {
+        return false;
+    }
+    int fd;
+    while ((fd = ::accept(int(m_fd), nullptr, nullptr)) < 0 && errno == EINTR) {}
+    if (fd < 0) {
+        return false;
+    }
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    client.close();
+    client.m_fd = fd;
+    return true;
+}
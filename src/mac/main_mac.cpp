@@ -9,8 +9,11 @@
 #include "SerialPort.h"
 #include "FileDialog.h"
 #include "Xmodem.h"
+#include "Upload.h"
 #include "Console.h"
 #include "SendGCode.h"
+#include "LineEditor.h"
+#include "RemoteCache.h"
 
 static void errorExit(const char* msg) {
     std::cerr << msg << std::endl;
@@ -47,15 +50,14 @@ void resetFluidNC() {
     enableFluidEcho();
 }
 
+// Tab completes names from the controller's file listing
 static const char* getSaveName(const char* proposal) {
     editModeOn();
 
     static std::string saveName;
 
-    std::cout << "FluidNC filename [" << proposal << "]: ";
-    std::getline(std::cin, saveName);
-
-    if (saveName.length() == 0) {
+    auto complete = [](const std::string& partial) { return remoteFileCache().complete(comport, partial); };
+    if (!editLine(std::string("FluidNC filename [") + proposal + "]: ", saveName, complete) || saveName.length() == 0) {
         saveName = proposal;
     }
 
@@ -128,67 +130,6 @@ void sendOverride() {
     }
 }
 
-off_t fileSize(const char* name) {
-    struct stat st;
-    if (stat(name, &st) != 0) {
-        return -1;
-    }
-    return st.st_size;
-}
-
-void uploadFile(const std::string& path, const std::string& remoteName) {
-    std::ifstream infile(path, std::ifstream::in | std::ifstream::binary);
-    if (infile.fail()) {
-        std::cout << "Can't open " << path << std::endl;
-        return;
-    }
-    
-    int size = fileSize(path.c_str());
-    std::cout << "XModem Upload " << path << " " << remoteName << std::endl;
-
-    std::string msg = "$Xmodem/Receive=";
-    msg += remoteName;
-    msg += '\n';
-    comport.setDirect();
-    comport.write(msg);
-    int ch;
-    while (true) {
-        ch = comport.timedRead(1);
-
-        if (ch == -1) {
-        } else if (ch == 0x18 || ch == 0x04) {
-            // 0x18 is the correct cancel character but older FluidNC versions use 0x04
-            std::cout << "FluidNC cancelled the upload" << std::endl;
-            comport.setIndirect();
-            break;
-        } else if (ch == 'C') {
-            int ret = xmodemTransmit(comport, infile);
-            comport.flushInput();
-            comport.setIndirect();
-            if (ret < 0) {
-                std::cout << "Returned " << ret << std::endl;
-            }
-            break;
-        } else if (ch == '$') {
-            std::cout << (char)ch;
-            // FluidNC is echoing the line
-            do {
-                ch = comport.timedRead(1);
-                if (ch != -1) {
-                    std::cout << (char)ch;
-                }
-            } while (ch != '\n');
-        } else if (ch == '\n') {
-            std::cout << (char)ch;
-        } else if (ch == 'e') {
-            // Probably an "error:N" message
-            std::cout << (char)ch;
-            comport.setIndirect();
-            break;
-        }
-    }
-}
-
 const char* uploadpath = nullptr;
 
 int main(int argc, char** argv) {
@@ -246,7 +187,7 @@ int main(int argc, char** argv) {
         } else {
             remoteName = getSaveName(fileTail(uploadName.c_str()));
         }
-        uploadFile(uploadName, remoteName);
+        uploadFile(comport, uploadName, remoteName);
         okayExit("Upload complete");
     }
 
@@ -277,7 +218,7 @@ int main(int argc, char** argv) {
                 std::string path;
                 if (showOpenFileDialog(path, "*.g;*.nc;*.gcode", "Open G-Code File")) {
                     std::string remoteName = getSaveName(fileTail(path.c_str()));
-                    uploadFile(path, remoteName);
+                    uploadFile(comport, path, remoteName);
                 }
             } else if (line == "load") {
                 std::string path;
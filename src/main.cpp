@@ -8,10 +8,31 @@
 #include "SerialPort.h"
 #include "FileDialog.h"
 #include "Xmodem.h"
+#include "Upload.h"
 #include "stm32loader/stm32action.h"
 #include "Console.h"
 #include "SendGCode.h"
+#include "HeightMap.h"
+#include "Probe.h"
+#include "Fixture.h"
+#include "DrillOptimizer.h"
+#include "GCodeCache.h"
+#include "FileSystem.h"
+#include "RunRemote.h"
+#include "LinkAnalysis.h"
+#include "JobQueue.h"
+#include "GCodeFile.h"
+#include "Pipeline.h"
+#include "Sync.h"
+#include "Backup.h"
+#include "LineEditor.h"
+#include "RemoteCache.h"
+#include "Crc.h"
+#include "HttpUpload.h"
+#include <chrono>
+#include <sstream>
 #include <unistd.h>
+#include <getopt.h>
 
 static void errorExit(const char* msg) {
     std::cerr << msg << std::endl;
@@ -28,6 +49,9 @@ static SerialPort comport;
 static void okayExit(const char* msg) {
     comport.write("\x0c");  // Send CTRL-L to exit FluidNC echo mode
     std::cerr << msg << std::endl;
+#ifdef COUNT_ALLOCATIONS
+    std::cerr << colorizeAllocations() << " heap allocations in the console output path" << std::endl;
+#endif
     Sleep(1000);
 
     // Restore input mode on exit.
@@ -48,21 +72,59 @@ void resetFluidNC() {
     enableFluidEcho();
 }
 
-static const char* getSaveName(const char* proposal) {
-    editModeOn();
+// Tab completes names from the controller's file listing
+static std::vector<std::string> completeRemote(const std::string& partial) {
+    return remoteFileCache().complete(comport, partial);
+}
 
+// Returns "" if the prompt is given up
+static const char* getSaveName(const char* proposal) {
     static std::string saveName;
 
-    std::cout << "FluidNC filename [" << proposal << "]: ";
-    std::getline(std::cin, saveName);
-
-    if (saveName.length() == 0) {
+    if (!editLine(std::string("FluidNC filename [") + proposal + "]: ", saveName, completeRemote)) {
+        saveName.clear();
+    } else if (saveName.length() == 0) {
         saveName = proposal;
     }
+    return saveName.c_str();
+}
 
-    editModeOff();
+// Asks which controller file to download and where to put it
+static void downloadPrompt() {
+    std::string remoteName, path;
+    if (editLine("FluidNC file to download: ", remoteName, completeRemote) && remoteName.length()) {
+        std::string tail = remoteName.substr(remoteName.rfind('/') + 1);
+        if (!editLine("Local filename [" + tail + "]: ", path)) {
+            remoteName.clear();
+        } else if (path.length() == 0) {
+            path = tail;
+        }
+    }
+    if (remoteName.length() == 0) {
+        std::cout << "No file selected" << std::endl;
+        return;
+    }
+    downloadFile(comport, remoteName, path);
+}
 
-    return saveName.c_str();
+// Lists a controller directory from the cached listing
+static void listPrompt() {
+    std::string dir;
+    if (!editLine("FluidNC directory [/localfs/]: ", dir, completeRemote)) {
+        return;
+    }
+    if (dir.length() == 0) {
+        dir = "/localfs/";
+    }
+    std::vector<RemoteFile> files;
+    if (!remoteFileCache().list(comport, dir, files)) {
+        std::cout << "Cannot list " << dir << std::endl;
+        return;
+    }
+    for (auto& file : files) {
+        std::cout << file.name << "  " << file.size << std::endl;
+    }
+    std::cout << files.size() << " files" << std::endl;
 }
 
 struct cmd {
@@ -128,93 +190,411 @@ void sendOverride() {
     }
 }
 
-__int64 FileSize(const char* name) {
-    WIN32_FILE_ATTRIBUTE_DATA fad;
-    if (!GetFileAttributesEx(name, GetFileExInfoStandard, &fad))
-        return -1;  // error condition, could call GetLastError to find out more
-    LARGE_INTEGER size;
-    size.HighPart = fad.nFileSizeHigh;
-    size.LowPart  = fad.nFileSizeLow;
-    return size.QuadPart;
+const char* uploadpath = nullptr;
+
+static HeightMap heightMap;
+
+static std::vector<PartPlacement> fixtureParts;
+static double                     fixtureSafeZ = 5.0;
+
+static double drillRapid = 0;  // mm/min, 0 disables drill reordering
+
+static uint64_t cacheLimit = 256 << 20;  // bytes, 0 disables the preprocessing cache
+
+static uint32_t starvationPollMs = 0;  // status poll interval while sending, 0 disables
+
+static JobQueue jobQueue;
+static bool     pauseBetweenJobs = false;  // M0 before each queued job after the first
+
+static bool compactOutput = false;  // drop redundant words, whitespace and comments
+
+// Reorders drill holes into `optimized`, or finds the result of an
+// earlier run on the same contents in the cache.  Returns the stream
+// to send.
+static std::istream* optimizeDrillFile(std::istream& infile, std::stringstream& optimized, std::ifstream& cached) {
+    GCodeCache            cache(cacheDirectory(), cacheLimit);
+    std::string           settings = "drill " + std::to_string(drillRapid);
+    uint64_t              key      = cacheLimit ? GCodeCache::key(infile, settings) : 0;
+    std::vector<uint64_t> index;
+    std::string           cachedPath, report;
+    std::istream*         source;
+
+    if (cacheLimit && cache.lookup(key, cachedPath, index, report)) {
+        cached.open(cachedPath, std::ifstream::in | std::ifstream::binary);
+        source = &cached;
+        infoColor();
+        std::cout << "Using cached preprocessing, " << index.size() << " lines" << std::endl;
+    } else {
+        // The output goes straight into a new cache entry, or is held in
+        // memory if there is no cache or it cannot be written
+        DrillStats    stats;
+        std::ofstream entry;
+        bool          streamed = cacheLimit && cache.create(key, entry);
+        optimizeDrilling(infile, streamed ? static_cast<std::ostream&>(entry) : optimized, drillRapid, stats);
+
+        std::ostringstream text;
+        text << "Reordered " << stats.holes << " holes in " << stats.runs << " runs, rapid travel " << stats.before << " -> "
+             << stats.after << " mm, saving about " << stats.seconds << " s";
+        report = text.str();
+        if (streamed && cache.finish(key, entry, report, cachedPath)) {
+            cached.open(cachedPath, std::ifstream::in | std::ifstream::binary);
+            source = &cached;
+        } else {
+            if (streamed) {
+                infile.clear();
+                infile.seekg(0);
+                optimizeDrilling(infile, optimized, drillRapid, stats);
+            }
+            source = &optimized;
+        }
+        infoColor();
+    }
+    std::cout << report << std::endl;
+    normalColor();
+    return source;
 }
 
-void uploadFile(const std::string& path, const std::string& remoteName) {
-    std::ifstream infile(path, std::ifstream::in | std::ifstream::binary);
-    if (infile.fail()) {
-        std::cout << "Can't open " << path << std::endl;
-        return;
+// Sends a job with the current drill, fixture, leveling and starvation
+// settings.  Returns negative if the job stopped on an error.
+static int sendGCodeStream(std::istream& infile) {
+    std::stringstream optimized;
+    std::ifstream     cached;
+    std::istream*     source = &infile;
+    if (drillRapid > 0) {
+        source = optimizeDrillFile(infile, optimized, cached);
     }
-    // auto size = std::filesystem::file_size(path);
-    int size = FileSize(path.c_str());
-    std::cout << "XModem Upload " << path << " " << remoteName << std::endl;
-
-    std::string msg = "$Xmodem/Receive=";
-    msg += remoteName;
-    //    msg += ':';
-    //    msg += std::to_string(size);
-    msg += '\n';
-    comport.setDirect();
-    comport.write(msg);
-    int ch;
-    while (true) {
-        ch = comport.timedRead(1);
 
-        if (ch == -1) {
-        } else if (ch == 0x18 || ch == 0x04) {
-            // 0x18 is the correct cancel character but older FluidNC versions use 0x04
-            std::cout << "FluidNC cancelled the upload" << std::endl;
-            comport.setIndirect();
-            break;
-        } else if (ch == 'C') {
-            int ret = xmodemTransmit(comport, infile);
-            comport.flushInput();
-            comport.setIndirect();
-            if (ret < 0) {
-                std::cout << "Returned " << ret << std::endl;
-            }
+    LevelingTransform  leveling(heightMap);
+    ModalTracker       modal(true);
+    Encoder            encoder(true);
+    TransformChain     chain;
+    GCodeTransform*    transform = heightMap.empty() ? nullptr : &leveling;
+    if (compactOutput) {
+        if (transform) {
+            chain.add(transform);
+        }
+        chain.add(&modal);
+        chain.add(&encoder);
+        transform = &chain;
+    }
+
+    StarvationMonitor  starvation(starvationPollMs);
+    StarvationMonitor* monitor = starvationPollMs ? &starvation : nullptr;
+    int                ret;
+    if (monitor) {
+        monitor->start();
+    }
+    if (fixtureParts.empty()) {
+        ret = sendGCode(comport, *source, transform, monitor);
+    } else {
+        ret = sendFixtureJob(comport, *source, fixtureParts, fixtureSafeZ, transform, monitor);
+    }
+    if (monitor) {
+        infoColor();
+        monitor->report(std::cout);
+        normalColor();
+    }
+    return ret;
+}
+
+static void sendGCodeFile(const char* path) {
+    infoColor();
+    std::cout << "Sending " << path << std::endl;
+    normalColor();
+    GCodeFile infile(path);
+    int       ret = sendGCodeStream(infile);
+    infoColor();
+    if (ret < 0) {
+        std::cout << "Sending stopped by error" << std::endl;
+    } else {
+        std::cout << "Sending succeeded" << std::endl;
+    }
+    normalColor();
+}
+
+// Runs the queued jobs back to back.  A job that fails its preflight is
+// skipped; one that stops on an error stops the queue.
+static void runJobQueue() {
+    using clock = std::chrono::steady_clock;
+
+    bool       first = true;
+    QueuedJob* job;
+    while ((job = jobQueue.next()) != nullptr) {
+        if (job->error.length()) {
+            job->state = QueuedJob::FAILED;
+            errorColor();
+            std::cout << "Skipping " << job->path << ": " << job->error << std::endl;
+            normalColor();
+            continue;
+        }
+        if (!first && pauseBetweenJobs && pauseBeforeJob(comport, job->path) < 0) {
+            job->state = QueuedJob::SKIPPED;
             break;
-        } else if (ch == '$') {
-            std::cout << (char)ch;
-            // FluidNC is echoing the line
-            do {
-                ch = comport.timedRead(1);
-                if (ch != -1) {
-                    std::cout << (char)ch;
-                }
-            } while (ch != '\n');
-        } else if (ch == '\n') {
-            std::cout << (char)ch;
-        } else if (ch == 'e') {
-            // Probably an "error:N" message
-            std::cout << (char)ch;
-            comport.setIndirect();
+        }
+        first = false;
+
+        infoColor();
+        std::cout << "Sending " << job->path << " (" << job->index.size() << " lines, " << jobQueue.pending() << " more queued)"
+                  << std::endl;
+        normalColor();
+        JobSource    source(*job);
+        std::istream infile(&source);
+        auto         start = clock::now();
+        int          ret   = sendGCodeStream(infile);
+        job->seconds       = std::chrono::duration<double>(clock::now() - start).count();
+        if (ret < 0) {
+            job->state = QueuedJob::FAILED;
+            job->error = "stopped by error";
             break;
         }
+        job->state = QueuedJob::DONE;
     }
+    jobQueue.skipRest();
+    infoColor();
+    std::cout << "Job queue:" << std::endl;
+    jobQueue.report(std::cout);
+    normalColor();
 }
 
-const char* uploadpath = nullptr;
+// Predicts whether the link can feed the planner for this job
+static void analyzeJob(const char* path, uint32_t baud) {
+    GCodeFile infile(path);
+    if (infile.fail()) {
+        std::cout << "Cannot open " << path << std::endl;
+        return;
+    }
+    LevelingTransform leveling(heightMap);
+    LinkModel         model;
+    LinkReport        report;
+    model.baud = baud;
+    analyzeLink(infile, heightMap.empty() ? nullptr : &leveling, model, report);
+    printLinkReport(report, model, std::cout);
+}
+
+// Runs the job through the send pipeline without a port and reports
+// the throughput of each stage
+static void benchmarkJob(const char* path) {
+    GCodeFile infile(path);
+    if (infile.fail()) {
+        std::cout << "Cannot open " << path << std::endl;
+        return;
+    }
+    LevelingTransform            leveling(heightMap);
+    ModalTracker                 modal(compactOutput);
+    Encoder                      encoder(compactOutput);
+    std::vector<GCodeTransform*> stages;
+    if (!heightMap.empty()) {
+        stages.push_back(&leveling);
+    }
+    stages.push_back(&modal);
+    stages.push_back(&encoder);
+    benchmarkPipeline(infile, stages, std::cout);
+}
+
+static void probeHeightMap() {
+    editModeOn();
+    std::string line;
+    std::cout << "Probe grid X0 Y0 X1 Y1 NX NY [depth clearance feed]: ";
+    std::getline(std::cin, line);
+
+    ProbeGrid grid { 0, 0, 0, 0, 0, 0, -2.0, 2.0, 50.0 };
+    int       n = sscanf(line.c_str(),
+                   "%lf %lf %lf %lf %d %d %lf %lf %lf",
+                   &grid.x0,
+                   &grid.y0,
+                   &grid.x1,
+                   &grid.y1,
+                   &grid.nx,
+                   &grid.ny,
+                   &grid.depth,
+                   &grid.clearance,
+                   &grid.feed);
+    if (n < 6) {
+        editModeOff();
+        std::cout << "Probing cancelled" << std::endl;
+        return;
+    }
+
+    std::string mapName;
+    std::cout << "Height map file [heightmap.txt]: ";
+    std::getline(std::cin, mapName);
+    if (mapName.length() == 0) {
+        mapName = "heightmap.txt";
+    }
+    editModeOff();
+
+    HeightMap map;
+    int       ret = probeGrid(comport, grid, map);
+    infoColor();
+    if (ret < 0) {
+        std::cout << "Probing stopped by error" << std::endl;
+    } else if (!map.save(mapName)) {
+        std::cout << "Cannot write " << mapName << std::endl;
+    } else {
+        heightMap = map;
+        std::cout << "Height map saved to " << mapName << " and applied to Ctrl-G sends" << std::endl;
+    }
+    normalColor();
+}
 
 int main(int argc, char** argv) {
     std::string comName;
-    std::string uploadName;
+    std::vector<std::string> uploadNames;
+    std::string              manifestName;
+    std::string downloadName;
+    std::string syncDir;
+    std::string backupName;
+    std::string restoreName;
+    std::string syncRemote = "/localfs/";
+    bool        syncDelete = false;
     std::string remoteName;
+    std::string mapName;
+    std::string fixtureName;
+    std::string runName;
+    std::string analyzeName;
+    std::string benchmarkName;
+    bool        crcBenchmark      = false;
+    bool        colorizeBenchmark = false;
+    bool        httpTest          = false;
+    bool        fixtureTest       = false;
+    bool        monitor           = false;
+    uint32_t    pollMs            = 1000;
+    uint32_t    baud              = 115200;
+
+    enum { OPT_RUN_REMOTE = 256, OPT_MONITOR, OPT_POLL, OPT_ANALYZE, OPT_BAUD, OPT_STARVATION, OPT_QUEUE, OPT_PAUSE, OPT_COMPACT, OPT_BENCHMARK, OPT_SYNC, OPT_DELETE, OPT_NO_VERIFY, OPT_COMPRESS, OPT_HOST, OPT_BACKUP, OPT_RESTORE, OPT_MANIFEST, OPT_CRC_BENCHMARK, OPT_COLORIZE_BENCHMARK, OPT_HTTP_TEST, OPT_FIXTURE_TEST };
+    static const struct option longOptions[] = {
+        { "run-remote", required_argument, nullptr, OPT_RUN_REMOTE },
+        { "monitor", no_argument, nullptr, OPT_MONITOR },
+        { "poll", required_argument, nullptr, OPT_POLL },
+        { "analyze", required_argument, nullptr, OPT_ANALYZE },
+        { "baud", required_argument, nullptr, OPT_BAUD },
+        { "starvation", required_argument, nullptr, OPT_STARVATION },
+        { "queue", required_argument, nullptr, OPT_QUEUE },
+        { "pause", no_argument, nullptr, OPT_PAUSE },
+        { "compact", no_argument, nullptr, OPT_COMPACT },
+        { "benchmark", required_argument, nullptr, OPT_BENCHMARK },
+        { "sync", required_argument, nullptr, OPT_SYNC },
+        { "delete", no_argument, nullptr, OPT_DELETE },
+        { "no-verify", no_argument, nullptr, OPT_NO_VERIFY },
+        { "compress", no_argument, nullptr, OPT_COMPRESS },
+        { "host", required_argument, nullptr, OPT_HOST },
+        { "backup", required_argument, nullptr, OPT_BACKUP },
+        { "restore", required_argument, nullptr, OPT_RESTORE },
+        { "manifest", required_argument, nullptr, OPT_MANIFEST },
+        { "crc-benchmark", no_argument, nullptr, OPT_CRC_BENCHMARK },
+        { "colorize-benchmark", no_argument, nullptr, OPT_COLORIZE_BENCHMARK },
+        { "http-test", no_argument, nullptr, OPT_HTTP_TEST },
+        { "fixture-test", no_argument, nullptr, OPT_FIXTURE_TEST },
+        { nullptr, 0, nullptr, 0 },
+    };
 
     opterr = 0;
     int c;
-    while ((c = getopt(argc, argv, "p:u:r:")) != -1) {
+    while ((c = getopt_long(argc, argv, "p:u:d:r:l:f:O:C:", longOptions, nullptr)) != -1) {
         switch (c) {
+            case OPT_RUN_REMOTE:
+                runName = optarg;
+                break;
+            case OPT_MONITOR:
+                monitor = true;
+                break;
+            case OPT_POLL:
+                pollMs = atoi(optarg);
+                break;
+            case OPT_ANALYZE:
+                analyzeName = optarg;
+                break;
+            case OPT_BAUD:
+                baud = atoi(optarg);
+                break;
+            case OPT_STARVATION:
+                starvationPollMs = atoi(optarg);
+                break;
+            case OPT_QUEUE:
+                jobQueue.add(optarg);
+                break;
+            case OPT_PAUSE:
+                pauseBetweenJobs = true;
+                break;
+            case OPT_COMPACT:
+                compactOutput = true;
+                break;
+            case OPT_BENCHMARK:
+                benchmarkName = optarg;
+                break;
+            case OPT_SYNC:
+                // --sync <dir> [<remote/>]
+                syncDir = optarg;
+                if (optind < argc && argv[optind][0] != '-') {
+                    syncRemote = argv[optind++];
+                }
+                break;
+            case OPT_DELETE:
+                syncDelete = true;
+                break;
+            case OPT_NO_VERIFY:
+                setUploadVerify(false);
+                break;
+            case OPT_COMPRESS:
+                setUploadCompress(true);
+                break;
+            case OPT_HOST:
+                // --host <address[:port]> or --host off
+                setUploadHost(optarg);
+                break;
+            case OPT_BACKUP:
+                backupName = optarg;
+                break;
+            case OPT_RESTORE:
+                restoreName = optarg;
+                break;
+            case OPT_MANIFEST:
+                manifestName = optarg;
+                break;
+            case OPT_CRC_BENCHMARK:
+                crcBenchmark = true;
+                break;
+            case OPT_COLORIZE_BENCHMARK:
+                colorizeBenchmark = true;
+                break;
+            case OPT_HTTP_TEST:
+                httpTest = true;
+                break;
+            case OPT_FIXTURE_TEST:
+                fixtureTest = true;
+                break;
             case 'p':
                 comName = optarg;
                 break;
             case 'u':
-                uploadName = optarg;
+                // -u <file|dir|pattern> ..., e.g. as the shell expanded a pattern
+                uploadNames.push_back(optarg);
+                while (optind < argc && argv[optind][0] != '-') {
+                    uploadNames.push_back(argv[optind++]);
+                }
+                break;
+            case 'd':
+                downloadName = optarg;
                 break;
             case 'r':
                 remoteName = optarg;
                 break;
+            case 'l':
+                mapName = optarg;
+                break;
+            case 'f':
+                fixtureName = optarg;
+                break;
+            case 'O':
+                drillRapid = atof(optarg);
+                break;
+            case 'C':
+                cacheLimit = uint64_t(atof(optarg) * (1 << 20));
+                break;
             case '?':
-                if (optopt == 'p' || optopt == 'u' || optopt == 'd')
+                if (optopt >= OPT_RUN_REMOTE)
+                    fprintf(stderr, "Option --%s requires an argument.\n", longOptions[optopt - OPT_RUN_REMOTE].name);
+                else if (optopt == 'p' || optopt == 'u' || optopt == 'd' || optopt == 'r' || optopt == 'l' || optopt == 'f' || optopt == 'O' || optopt == 'C')
                     fprintf(stderr, "Option -%c requires an argument.\n", optopt);
                 else if (isprint(optopt))
                     fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -228,6 +608,39 @@ int main(int argc, char** argv) {
     for (int index = optind; index < argc; index++)
         printf("Non-option argument %s\n", argv[index]);
 
+    if (mapName.length() && !heightMap.load(mapName)) {
+        std::string errorstr("Cannot load height map ");
+        errorstr += mapName;
+        errorExit(errorstr.c_str());
+    }
+    if (fixtureName.length() && !loadFixtures(fixtureName, fixtureParts, fixtureSafeZ)) {
+        std::string errorstr("Cannot load fixture list ");
+        errorstr += fixtureName;
+        errorExit(errorstr.c_str());
+    }
+
+    if (analyzeName.length()) {
+        analyzeJob(analyzeName.c_str(), baud);
+        return 0;
+    }
+    if (benchmarkName.length()) {
+        benchmarkJob(benchmarkName.c_str());
+        return 0;
+    }
+    if (crcBenchmark) {
+        return benchmarkChecksums(std::cout) ? 0 : 1;
+    }
+    if (colorizeBenchmark) {
+        benchmarkColorize(std::cout);
+        return 0;
+    }
+    if (httpTest) {
+        return testHttpUpload(std::cout) ? 0 : 1;
+    }
+    if (fixtureTest) {
+        return testFixtureJob(std::cout) ? 0 : 1;
+    }
+
     editModeOn();
     if (comName.length() == 0 && !selectComPort(comName)) {
         editModeOff();
@@ -236,22 +649,50 @@ int main(int argc, char** argv) {
     editModeOff();
 
     // Start a thread to read the serial port and send to the console
-    if (!comport.Init(comName.c_str(), 115200)) {
+    if (!comport.Init(comName.c_str(), baud)) {
         std::string errorstr("Cannot open ");
         errorstr += comName;
         errorExit(errorstr.c_str());
     }
+    setUploadBaud(baud);
 
-    if (uploadName.length()) {
-        if (remoteName.length()) {
-            if (remoteName.back() == '/') {
-                remoteName += fileTail(uploadName.c_str());
-            }
-        } else {
-            remoteName = fileTail(uploadName.c_str());
+    if (syncDir.length()) {
+        int ret = syncDirectory(comport, syncDir, syncRemote, syncDelete);
+        okayExit(ret < 0 ? "Sync failed" : "Done");
+    }
+    if (backupName.length()) {
+        int ret = backupFilesystem(comport, backupName);
+        okayExit(ret < 0 ? "Backup failed" : "Done");
+    }
+    if (restoreName.length()) {
+        int ret = restoreFilesystem(comport, restoreName);
+        okayExit(ret < 0 ? "Restore failed" : "Done");
+    }
+    if (downloadName.length()) {
+        // Into the current directory under the same name
+        int ret = downloadFile(comport, downloadName, downloadName.substr(downloadName.rfind('/') + 1));
+        okayExit(ret < 0 ? "Download failed" : "Done");
+    }
+
+    if (uploadNames.size() || manifestName.length()) {
+        // Everything goes up in one session, in as few batches as the
+        // files can be read and hashed for.  -r names a lone file, and
+        // is the directory for several.
+        std::vector<UploadItem> items;
+        bool                    ok     = true;
+        std::string             remote = remoteName;
+        if (remote.length() && remote.back() != '/' && (uploadNames.size() > 1 || manifestName.length())) {
+            remote += '/';
+        }
+        for (auto& name : uploadNames) {
+            ok &= addUploads(name, remote, items);
+        }
+        if (manifestName.length()) {
+            ok &= readUploadManifest(manifestName, remoteName, items);
         }
-        uploadFile(uploadName, remoteName);
-        okayExit("Done");
+        int sent = items.empty() ? 0 : uploadFiles(comport, items);
+        std::cout << (sent < 0 ? 0 : sent) << " of " << items.size() << " files uploaded" << std::endl;
+        okayExit(ok && sent == int(items.size()) ? "Done" : "Upload failed");
     }
 
     if (!setConsoleColor()) {
@@ -262,9 +703,41 @@ int main(int argc, char** argv) {
         errorExit("setConsoleModes failed");
     }
 
+    if (runName.length() || monitor) {
+        int ret;
+        if (runName.length()) {
+            if (remoteName.length() == 0) {
+                remoteName = "/sd/";
+            }
+            if (remoteName.back() == '/') {
+                remoteName += fileTail(runName.c_str());
+            }
+            ret = runRemote(comport, runName, remoteName, pollMs);
+        } else {
+            ret = monitorRemote(comport, pollMs);
+        }
+        okayExit(ret < 0 ? "Remote job stopped by error" : "Done");
+    }
+
     std::cout << "FluidTerm " << VERSION << " using " << comName << std::endl;
     std::cout << "Exit: Ctrl-C, Ctrl-Q or Ctrl-], Clear screen: CTRL-W" << std::endl;
-    std::cout << "Upload: Ctrl-U, Reset ESP32: Ctrl-R, Send Override: Ctrl-O, STM32 Loader: Ctrl-S" << std::endl;
+    std::cout << "Upload: Ctrl-U, Download: Ctrl-D, Reset ESP32: Ctrl-R, Send Override: Ctrl-O, STM32 Loader: Ctrl-S" << std::endl;
+    std::cout << "Send GCode: Ctrl-G, Probe height map: Ctrl-P" << std::endl;
+    std::cout << "Queue GCode: Ctrl-E, Run queue: Ctrl-K" << std::endl;
+    if (!heightMap.empty()) {
+        std::cout << "Height map " << mapName << " (" << heightMap.nx() << "x" << heightMap.ny() << ") applied to Ctrl-G sends"
+                  << std::endl;
+    }
+    if (!fixtureParts.empty()) {
+        std::cout << "Fixture " << fixtureName << ": Ctrl-G runs the job for " << fixtureParts.size() << " parts" << std::endl;
+    }
+    if (drillRapid > 0) {
+        std::cout << "Drill holes are reordered before Ctrl-G sends" << std::endl;
+    }
+
+    if (jobQueue.pending()) {
+        runJobQueue();
+    }
 
     enableFluidEcho();
 
@@ -294,28 +767,46 @@ int main(int argc, char** argv) {
                     std::cout << "No file selected" << std::endl;
                 } else {
                     const char* remoteName = getSaveName(fileTail(path));
-                    uploadFile(path, remoteName);
+                    if (*remoteName) {
+                        uploadFile(comport, path, remoteName);
+                    }
                 }
             } break;
+            case CTRL('D'): {  // ^D
+                downloadPrompt();
+            } break;
+            case CTRL('F'): {  // ^F
+                listPrompt();
+            } break;
             case CTRL('G'): {  // ^G
-                const char* path = getFileName("GCode\0*.gc;*.gcode;*.nc\0All\0*.*\0");
+                const char* path = getFileName("GCode\0*.gc;*.gcode;*.nc;*.gz\0All\0*.*\0");
                 if (*path == '\0') {
                     std::cout << "No file selected" << std::endl;
                 } else {
-                    infoColor();
-                    std::cout << "Sending " << path << std::endl;
-                    normalColor();
-                    std::ifstream infile(path, std::ifstream::in | std::ifstream::binary);
-                    int           ret = sendGCode(comport, infile);
-                    infoColor();
-                    if (ret < 0) {
-                        std::cout << "Sending stopped by error" << std::endl;
-                    } else {
-                        std::cout << "Sending succeeded" << std::endl;
-                    }
-                    normalColor();
+                    sendGCodeFile(path);
+                }
+            } break;
+
+            case CTRL('E'): {  // ^E
+                const char* path = getFileName("GCode\0*.gc;*.gcode;*.nc;*.gz\0All\0*.*\0");
+                if (*path == '\0') {
+                    std::cout << "No file selected" << std::endl;
+                } else {
+                    jobQueue.add(path);
+                    std::cout << "Queued " << path << ", " << jobQueue.pending() << " jobs waiting" << std::endl;
                 }
             } break;
+            case CTRL('K'): {  // ^K
+                if (jobQueue.pending()) {
+                    runJobQueue();
+                } else {
+                    std::cout << "The job queue is empty" << std::endl;
+                }
+            } break;
+
+            case CTRL('P'): {  // ^P
+                probeHeightMap();
+            } break;
 
             case CTRL(']'):
                 okayExit("Exited by ^]");
@@ -29,6 +29,7 @@
 #include "stm32.h"
 #include "port.h"
 #include "utils.h"
+#include "../Crc.h"
 
 #define STM32_ACK 0x79
 #define STM32_NACK 0x1F
@@ -1055,37 +1056,15 @@ stm32_err_t stm32_crc_memory(const stm32_t* stm, uint32_t address, uint32_t leng
  * implemented, for example, in Linux kernel in ./lib/crc32.c
  * But STM32 computes it on units of 32 bits word and swaps the
  * bytes of the word before the computation.
- * Due to byte swap, I cannot use any CRC available in existing
- * libraries, so here is a simple not optimized implementation.
+ * crc32Stm32() takes it in that form.
  */
-#define CRCPOLY_BE 0x04c11db7
-#define CRC_MSBMASK 0x80000000
 #define CRC_INIT_VALUE 0xFFFFFFFF
 uint32_t stm32_sw_crc(uint32_t crc, uint8_t* buf, unsigned int len) {
-    int      i;
-    uint32_t data;
-
     if (len & 0x3) {
         fprintf(stderr, "Buffer length must be multiple of 4 bytes\n");
         return 0;
     }
-
-    while (len) {
-        data = *buf++;
-        data |= *buf++ << 8;
-        data |= *buf++ << 16;
-        data |= *buf++ << 24;
-        len -= 4;
-
-        crc ^= data;
-
-        for (i = 0; i < 32; i++)
-            if (crc & CRC_MSBMASK)
-                crc = (crc << 1) ^ CRCPOLY_BE;
-            else
-                crc = (crc << 1);
-    }
-    return crc;
+    return crc32Stm32(crc, buf, len);
 }
 
 stm32_err_t stm32_crc_wrapper(const stm32_t* stm, uint32_t address, uint32_t length, uint32_t* crc) {
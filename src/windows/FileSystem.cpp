@@ -0,0 +1,105 @@
+#include "FileSystem.h"
+#include <windows.h>
+#include <cstdlib>
+#include <cstring>
+
+// FILETIME counts 100ns intervals since 1601
+static int64_t unixTime(const FILETIME& ft) {
+    LARGE_INTEGER t;
+    t.HighPart = ft.dwHighDateTime;
+    t.LowPart  = ft.dwLowDateTime;
+    return (t.QuadPart - 116444736000000000LL) / 10000000;
+}
+
+int64_t fileSize(const char* name) {
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesEx(name, GetFileExInfoStandard, &fad))
+        return -1;  // error condition, could call GetLastError to find out more
+    LARGE_INTEGER size;
+    size.HighPart = fad.nFileSizeHigh;
+    size.LowPart  = fad.nFileSizeLow;
+    return size.QuadPart;
+}
+
+bool listDirectory(const std::string& dir, std::vector<FileInfo>& entries) {
+    WIN32_FIND_DATAA fd;
+    std::string      pattern = dir + "\\*";
+    HANDLE           h       = FindFirstFileA(pattern.c_str(), &fd);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        if (!strcmp(fd.cFileName, ".") || !strcmp(fd.cFileName, "..")) {
+            continue;
+        }
+        LARGE_INTEGER size;
+        size.HighPart = fd.nFileSizeHigh;
+        size.LowPart  = fd.nFileSizeLow;
+        entries.push_back({ fd.cFileName, size.QuadPart, unixTime(fd.ftLastWriteTime), (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 });
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+    return true;
+}
+
+bool makeDirectories(const std::string& path) {
+    for (size_t pos = 0; pos != std::string::npos;) {
+        pos = path.find_first_of("/\\", pos + 1);
+        std::string part = path.substr(0, pos);
+        if (!CreateDirectoryA(part.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+            // Drive roots like "C:" cannot be created but exist
+            if (part.length() > 2 || part.back() != ':') {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool removeFile(const std::string& path) {
+    return DeleteFileA(path.c_str()) != 0;
+}
+
+bool touchFile(const std::string& path) {
+    HANDLE h = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    bool ok = SetFileTime(h, NULL, NULL, &now) != 0;
+    CloseHandle(h);
+    return ok;
+}
+
+std::string cacheDirectory() {
+    const char* base = getenv("LOCALAPPDATA");
+    std::string dir  = base ? base : ".";
+    return dir + "\\FluidTerm\\cache";
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size)) {
+        m_size = size_t(size.QuadPart);
+        if (m_size == 0) {
+            m_ok = true;  // empty files cannot be mapped
+        } else if ((m_handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL) {
+            m_data = static_cast<const char*>(MapViewOfFile(m_handle, FILE_MAP_READ, 0, 0, 0));
+            m_ok   = m_data != nullptr;
+        }
+    }
+    CloseHandle(file);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_handle) {
+        CloseHandle(m_handle);
+    }
+}
@@ -0,0 +1,147 @@
+#include "TcpSocket.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+// Winsock must be started once before any socket call
+struct Winsock {
+    Winsock() {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+    }
+    ~Winsock() { WSACleanup(); }
+};
+
+static void startWinsock() {
+    static Winsock winsock;
+}
+
+TcpSocket::~TcpSocket() {
+    close();
+}
+
+void TcpSocket::close() {
+    if (m_fd != -1) {
+        closesocket(SOCKET(m_fd));
+        m_fd = -1;
+    }
+}
+
+static bool waitFor(SOCKET s, bool write, uint32_t ms) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(s, &set);
+    fd_set failed;
+    FD_ZERO(&failed);
+    FD_SET(s, &failed);
+    struct timeval tv;
+    tv.tv_sec  = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    // A failed connect shows in the exception set, not the write set
+    int n = select(0, write ? nullptr : &set, write ? &set : nullptr, &failed, &tv);
+    return n > 0 && FD_ISSET(s, &set);
+}
+
+bool TcpSocket::connect(const std::string& host, uint16_t port, uint32_t ms) {
+    startWinsock();
+    close();
+    struct addrinfo hints = {};
+    hints.ai_family       = AF_UNSPEC;
+    hints.ai_socktype     = SOCK_STREAM;
+    struct addrinfo* list;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &list) != 0) {
+        return false;
+    }
+    for (struct addrinfo* ai = list; ai && m_fd == -1; ai = ai->ai_next) {
+        SOCKET s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s == INVALID_SOCKET) {
+            continue;
+        }
+        // Connect without blocking so the wait can be bounded
+        u_long nonblocking = 1;
+        ioctlsocket(s, FIONBIO, &nonblocking);
+        bool ok = ::connect(s, ai->ai_addr, int(ai->ai_addrlen)) == 0;
+        if (!ok && WSAGetLastError() == WSAEWOULDBLOCK) {
+            ok = waitFor(s, true, ms);
+        }
+        if (!ok) {
+            closesocket(s);
+            continue;
+        }
+        nonblocking = 0;
+        ioctlsocket(s, FIONBIO, &nonblocking);
+        m_fd = intptr_t(s);
+    }
+    freeaddrinfo(list);
+    return m_fd != -1;
+}
+
+bool TcpSocket::send(const char* data, size_t len, uint32_t ms) {
+    while (len) {
+        if (!waitFor(SOCKET(m_fd), true, ms)) {
+            return false;
+        }
+        int chunk = len > (1 << 30) ? (1 << 30) : int(len);
+        int n     = ::send(SOCKET(m_fd), data, chunk, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+int TcpSocket::recv(char* buf, size_t len, uint32_t ms) {
+    if (!waitFor(SOCKET(m_fd), false, ms)) {
+        return -1;
+    }
+    int n = ::recv(SOCKET(m_fd), buf, len > (1 << 30) ? (1 << 30) : int(len), 0);
+    return n < 0 ? -1 : n;
+}
+
+TcpListener::~TcpListener() {
+    close();
+}
+
+void TcpListener::close() {
+    if (m_fd != -1) {
+        closesocket(SOCKET(m_fd));
+        m_fd = -1;
+    }
+}
+
+bool TcpListener::listen(uint16_t& port) {
+    startWinsock();
+    close();
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) {
+        return false;
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family         = AF_INET;
+    addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+    addr.sin_port           = htons(port);
+    int len                 = sizeof(addr);
+    if (bind(s, reinterpret_cast<struct sockaddr*>(&addr), len) != 0 || ::listen(s, 4) != 0 ||
+        getsockname(s, reinterpret_cast<struct sockaddr*>(&addr), &len) != 0) {
+        closesocket(s);
+        return false;
+    }
+    port = ntohs(addr.sin_port);
+    m_fd = intptr_t(s);
+    return true;
+}
+
+bool TcpListener::accept(TcpSocket& client, uint32_t ms) {
+    // A pending connection shows as the listening socket being readable
+    if (m_fd == -1 || !waitFor(SOCKET(m_fd), false, ms)) {
+        return false;
+    }
+    SOCKET s = ::accept(SOCKET(m_fd), nullptr, nullptr);
+    if (s == INVALID_SOCKET) {
+        return false;
+    }
+    client.close();
+    client.m_fd = intptr_t(s);
+    return true;
+}